@@ -0,0 +1,11 @@
+CREATE TABLE IF NOT EXISTS `challenge_modes_telemetry` (
+  `challenge` TINYINT UNSIGNED NOT NULL,
+  `level` TINYINT UNSIGNED NOT NULL,
+  `xp_events` BIGINT UNSIGNED NOT NULL DEFAULT 0,
+  `xp_base` BIGINT UNSIGNED NOT NULL DEFAULT 0,
+  `xp_granted` BIGINT UNSIGNED NOT NULL DEFAULT 0,
+  `level_ups` INT UNSIGNED NOT NULL DEFAULT 0,
+  `level_time` BIGINT UNSIGNED NOT NULL DEFAULT 0,
+  `deaths` INT UNSIGNED NOT NULL DEFAULT 0,
+  PRIMARY KEY (`challenge`, `level`)
+) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_unicode_ci;
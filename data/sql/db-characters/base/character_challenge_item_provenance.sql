@@ -0,0 +1,7 @@
+CREATE TABLE IF NOT EXISTS `character_challenge_item_provenance` (
+  `item_guid` INT UNSIGNED NOT NULL,
+  `owner_guid` INT UNSIGNED NOT NULL,
+  `source` TINYINT UNSIGNED NOT NULL DEFAULT 0,
+  PRIMARY KEY (`item_guid`),
+  KEY `idx_owner` (`owner_guid`)
+) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_unicode_ci;
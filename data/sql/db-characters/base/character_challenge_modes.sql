@@ -0,0 +1,7 @@
+CREATE TABLE IF NOT EXISTS `character_challenge_modes` (
+  `guid` INT UNSIGNED NOT NULL,
+  `enabled_time` INT UNSIGNED NOT NULL DEFAULT 0,
+  `fallen_time` INT UNSIGNED NOT NULL DEFAULT 0,
+  `fallen_level` TINYINT UNSIGNED NOT NULL DEFAULT 0,
+  PRIMARY KEY (`guid`)
+) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_unicode_ci;
@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2016+ AzerothCore <www.azerothcore.org>, released under GNU AGPL v3 license: https://github.com/azerothcore/azerothcore-wotlk/blob/master/LICENSE-AGPL3
+ */
+
+#include "ChallengeItemProvenance.h"
+
+void ChallengeItemProvenanceTable::Set(uint32 itemGuid, ChallengeItemSource source)
+{
+    // Keep the load factor under 70% so probe sequences stay short
+    if ((_size + 1) * 10 > _keys.size() * 7)
+    {
+        Grow();
+    }
+
+    size_t slot = Slot(itemGuid);
+    while (_keys[slot] && _keys[slot] != itemGuid)
+    {
+        slot = (slot + 1) & (_keys.size() - 1);
+    }
+
+    if (!_keys[slot])
+    {
+        _keys[slot] = itemGuid;
+        ++_size;
+    }
+    _sources[slot] = source;
+}
+
+void ChallengeItemProvenanceTable::Grow()
+{
+    std::vector<uint32> keys = std::move(_keys);
+    std::vector<uint8> sources = std::move(_sources);
+
+    size_t capacity = keys.empty() ? MinCapacity : keys.size() * 2;
+    _keys.assign(capacity, 0);
+    _sources.assign(capacity, ITEM_SOURCE_NONE);
+    _shift = 32;
+    for (size_t c = capacity; c > 1; c >>= 1)
+    {
+        --_shift;
+    }
+    _size = 0;
+
+    for (size_t slot = 0; slot < keys.size(); ++slot)
+    {
+        if (keys[slot])
+        {
+            Set(keys[slot], ChallengeItemSource(sources[slot]));
+        }
+    }
+}
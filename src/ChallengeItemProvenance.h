@@ -0,0 +1,86 @@
+#ifndef AZEROTHCORE_CHALLENGEITEMPROVENANCE_H
+#define AZEROTHCORE_CHALLENGEITEMPROVENANCE_H
+
+#include "Define.h"
+#include <vector>
+
+// How a character obtained an item, stored in character_challenge_item_provenance.source
+enum ChallengeItemSource : uint8
+{
+    ITEM_SOURCE_NONE     = 0, // Not recorded, e.g. received by mail or obtained before the module tracked it
+    ITEM_SOURCE_STARTING = 1, // Owned when the character enabled its first challenge
+    ITEM_SOURCE_LOOTED   = 2, // Looted, including group rolls
+    ITEM_SOURCE_CRAFTED  = 3, // Created by a spell of the character
+    ITEM_SOURCE_QUEST    = 4,
+    ITEM_SOURCE_VENDOR   = 5,
+    ITEM_SOURCE_TRADED   = 6,
+    ITEM_SOURCE_OTHER    = 7, // Created for the character by the core without a more specific hook
+    ITEM_SOURCE_REWARD   = 8, // Challenge level reward, mailed by the module
+    ITEM_SOURCE_MAX
+};
+
+/*
+ * Item GUID to ChallengeItemSource map of one character. Open addressing with linear probing over two flat arrays,
+ * 5 bytes per slot, so lookups at equip time touch one or two cache lines. Entries are never removed one by one,
+ * the table is rebuilt with the items the character still owns when it is saved.
+ */
+class ChallengeItemProvenanceTable
+{
+public:
+    [[nodiscard]] ChallengeItemSource Find(uint32 itemGuid) const
+    {
+        if (_keys.empty())
+        {
+            return ITEM_SOURCE_NONE;
+        }
+
+        for (size_t slot = Slot(itemGuid);; slot = (slot + 1) & (_keys.size() - 1))
+        {
+            if (_keys[slot] == itemGuid)
+            {
+                return ChallengeItemSource(_sources[slot]);
+            }
+            if (!_keys[slot])
+            {
+                return ITEM_SOURCE_NONE;
+            }
+        }
+    }
+
+    void Set(uint32 itemGuid, ChallengeItemSource source);
+    [[nodiscard]] size_t Size() const { return _size; }
+
+    // Calls f(itemGuid, source) for every entry
+    template<class F>
+    void ForEach(F&& f) const
+    {
+        for (size_t slot = 0; slot < _keys.size(); ++slot)
+        {
+            if (_keys[slot])
+            {
+                f(_keys[slot], ChallengeItemSource(_sources[slot]));
+            }
+        }
+    }
+
+    void Clear()
+    {
+        _keys.clear();
+        _sources.clear();
+        _size = 0;
+    }
+
+private:
+    static constexpr size_t MinCapacity = 64;
+
+    // Fibonacci hashing, item GUIDs are sequential so the multiplication spreads neighbours over the table
+    [[nodiscard]] size_t Slot(uint32 itemGuid) const { return (uint32(itemGuid * 2654435769u) >> _shift) & (_keys.size() - 1); }
+    void Grow();
+
+    std::vector<uint32> _keys;  // 0 marks an empty slot, item GUIDs start at 1
+    std::vector<uint8> _sources;
+    size_t _size = 0;
+    uint8 _shift = 32;
+};
+
+#endif //AZEROTHCORE_CHALLENGEITEMPROVENANCE_H
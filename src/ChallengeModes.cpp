@@ -3,8 +3,25 @@
  */
 
 #include "ChallengeModes.h"
+#include "ChallengeModesAdmin.h"
+#include "ChallengeModesAnnouncer.h"
+#include "ChallengeModesAuditor.h"
+#include "ChallengeModesRegistry.h"
+#include "ChallengeModesShadow.h"
+#include "ChallengeModesSnapshot.h"
+#include "ChallengeModesTelemetry.h"
+#include "ChallengeModesTrace.h"
 #include "Tokenize.h"
+#include "Bag.h"
 #include "Player.h"
+#include "ObjectMgr.h"
+#include "ObjectAccessor.h"
+#include "GameTime.h"
+#include "Group.h"
+#include "Mail.h"
+#include "Opcodes.h"
+#include "WorldPacket.h"
+#include "SpellMgr.h"
 
 ChallengeModes* ChallengeModes::instance()
 {
@@ -14,169 +31,1163 @@ ChallengeModes* ChallengeModes::instance()
 
 void ChallengeModes::TryMarkDirty(Player* player)
 {
-    if (!player)
+    // Freshness only matters for selecting challenges at the shrine
+    if (!enabled() || !player)
+    {
+        return;
+    }
+
+    // Only the first event needs to write the setting
+    ChallengeModePlayerData* data = GetPlayerData(player);
+    if (data && data->dirty)
     {
         return;
     }
 
     if (player->IsInWorld())
     {
-        player->UpdatePlayerSetting("mod-challenge-modes", SETTING_MARK_DIRTY, 1);
+        SetPlayerSetting(player, PLAYER_SETTING_MARK_DIRTY, 1);
+    }
+}
+
+void ChallengeModes::AdjustXp(Player* player, uint32& amount, bool kill) const
+{
+    AdjustXp(&player, &amount, 1, kill);
+}
+
+void ChallengeModes::AdjustXp(Player* const* players, uint32* amounts, size_t count, bool kill) const
+{
+    if (!enabledChallengeMask)
+    {
+        return;
+    }
+
+    std::array<float, SETTING_MODE_MAX> xpMultipliers;
+    for (uint8 i = 0; i < SETTING_MODE_MAX; ++i)
+    {
+        xpMultipliers[i] = challenges[i].xpMultiplier;
+    }
+    uint8 const traits = kill ? CHALLENGE_TRAIT_KILL : 0;
+
+    // Recipients are processed in chunks of a full raid, so the masks stay on the stack
+    std::array<uint32, MAXRAIDSIZE> masks;
+    for (size_t first = 0; first < count; first += masks.size())
+    {
+        size_t const chunk = std::min(count - first, masks.size());
+        for (size_t i = 0; i < chunk; ++i)
+        {
+            masks[i] = GetEnforcedChallengeMask(players[first + i]);
+        }
+
+        if (!sChallengeModesTelemetry->telemetryEnabled)
+        {
+            ChallengeAdjustXpBatch(masks.data(), amounts + first, chunk, xpMultipliers, traits);
+            continue;
+        }
+
+        // Telemetry records every challenge step with the amount it started from
+        for (size_t i = 0; i < chunk; ++i)
+        {
+            uint32& amount = amounts[first + i];
+            for (uint8 challenge = 0; challenge < SETTING_MODE_MAX; ++challenge)
+            {
+                auto setting = ChallengeModeSettings(challenge);
+                if (masks[i] & ChallengeMask(setting))
+                {
+                    uint32 const baseAmount = amount;
+                    amount *= ChallengeXpStepMultiplier(setting, xpMultipliers, kill);
+                    sChallengeModesTelemetry->RecordXp(setting, players[first + i]->GetLevel(), baseAmount, amount);
+                }
+            }
+        }
+    }
+}
+
+void ChallengeModes::SetPlayerSetting(Player* player, uint8 index, uint32 value)
+{
+    player->UpdatePlayerSetting("mod-challenge-modes", index, value);
+
+    ChallengeModePlayerData* data = GetPlayerData(player);
+    if (!data)
+    {
+        return;
+    }
+
+    if (index == PLAYER_SETTING_MARK_DIRTY)
+    {
+        data->dirty = value == 1;
+    }
+    else if (index == PLAYER_SETTING_FALLEN)
+    {
+        data->fallen = value == 1;
+    }
+    else
+    {
+        for (uint8 i = 0; i < SETTING_MODE_MAX; ++i)
+        {
+            if (ChallengePlayerSettingIndex(ChallengeModeSettings(i)) == index)
+            {
+                uint32 mask = ChallengeMask(ChallengeModeSettings(i));
+                data->activeMask = value == 1 ? (data->activeMask | mask) : (data->activeMask & ~mask);
+            }
+        }
+        SyncEnchantmentRule(player);
+    }
+
+    if (index != PLAYER_SETTING_MARK_DIRTY)
+    {
+        sChallengeModesRegistry->Sync(player);
+    }
+}
+
+void ChallengeModes::SyncEnchantmentRule(Player* player)
+{
+    ChallengeModePlayerData* data = GetPlayerData(player);
+    if (!data)
+    {
+        return;
+    }
+
+    bool const noEnchants = GetActiveRuleFlags(player) & CHALLENGE_RULE_NO_ENCHANTS;
+    if (noEnchants != data->noEnchants)
+    {
+        data->noEnchants = noEnchants;
+        SyncEnchantmentBonuses(player, noEnchants);
+    }
+}
+
+void ChallengeModes::SyncEnchantmentRules()
+{
+    for (ChallengeRegistryEntry const& entry : sChallengeModesRegistry->Find(0, true))
+    {
+        if (Player* player = ObjectAccessor::FindPlayer(ObjectGuid::Create<HighGuid::Player>(entry.guid)))
+        {
+            SyncEnchantmentRule(player);
+        }
+    }
+}
+
+void ChallengeModes::SyncEnchantmentBonuses(Player* player, bool ruleApplies)
+{
+    ChallengeModePlayerData* data = GetPlayerData(player);
+    for (uint8 slot = EQUIPMENT_SLOT_START; slot < EQUIPMENT_SLOT_END; ++slot)
+    {
+        Item* item = player->GetItemByPos(INVENTORY_SLOT_BAG_0, slot);
+        if (!item || item->IsBroken())
+        {
+            continue;
+        }
+
+        for (uint8 enchantSlot = PERM_ENCHANTMENT_SLOT; enchantSlot < MAX_INSPECTED_ENCHANTMENT_SLOT; ++enchantSlot)
+        {
+            if (!item->GetEnchantmentId(EnchantmentSlot(enchantSlot)))
+            {
+                continue;
+            }
+
+            uint64 key = EnchantmentKey(item, EnchantmentSlot(enchantSlot));
+            if (ruleApplies)
+            {
+                // Applied while the rule did not apply yet, so its removal must be let through
+                data->appliedEnchantments.insert(key);
+            }
+            else if (!data->appliedEnchantments.count(key))
+            {
+                // Refused while the rule applied, the core removes it like any other once unequipped
+                player->ApplyEnchantment(item, EnchantmentSlot(enchantSlot), true);
+            }
+        }
+    }
+
+    if (!ruleApplies)
+    {
+        data->appliedEnchantments.clear();
+    }
+}
+
+bool ChallengeModes::CanApplyEnchantment(Player* player, Item* item, EnchantmentSlot slot, bool apply)
+{
+    // Items are equipped while the character loads, before HydratePlayerData records their bonuses
+    ChallengeModePlayerData* data = GetPlayerData(player);
+    if (!data)
+    {
+        return true;
+    }
+
+    if (apply)
+    {
+        return false;
+    }
+
+    // Only bonuses that were applied can be removed, the others were refused above
+    return data->appliedEnchantments.erase(EnchantmentKey(item, slot));
+}
+
+// The record may still be loading when these are written, so each write only touches its own columns
+void ChallengeModes::SaveEnabledTime(ObjectGuid guid, uint32 enabledTime)
+{
+    CharacterDatabase.Execute("INSERT INTO character_challenge_modes (guid, enabled_time) VALUES ({}, {}) ON DUPLICATE KEY UPDATE enabled_time = IF(enabled_time = 0, VALUES(enabled_time), enabled_time)",
+        guid.GetCounter(), enabledTime);
+}
+
+void ChallengeModes::SaveFallen(ObjectGuid guid, uint32 fallenTime, uint8 fallenLevel)
+{
+    CharacterDatabase.Execute("INSERT INTO character_challenge_modes (guid, fallen_time, fallen_level) VALUES ({}, {}, {}) ON DUPLICATE KEY UPDATE fallen_time = VALUES(fallen_time), fallen_level = VALUES(fallen_level)",
+        guid.GetCounter(), fallenTime, fallenLevel);
+}
+
+bool ChallengeModes::PrefetchPlayerData(ObjectGuid guid)
+{
+    // Bounds the records held for logins that never complete, HydratePlayerData loads the others at login
+    static constexpr size_t MaxPrefetchedRecords = 1024;
+
+    {
+        std::lock_guard<std::mutex> guard(_prefetchLock);
+        auto itr = _prefetched.find(guid.GetCounter());
+        if (itr != _prefetched.end() && !itr->second.ready)
+        {
+            return false;
+        }
+        if (itr == _prefetched.end() && _prefetched.size() >= MaxPrefetchedRecords)
+        {
+            return false;
+        }
+
+        PrefetchedRecord& prefetched = _prefetched[guid.GetCounter()];
+        prefetched = PrefetchedRecord();
+        prefetched.requestTime = getMSTime();
+    }
+
+    LoadRecord(guid);
+    return true;
+}
+
+void ChallengeModes::LoadRecord(ObjectGuid guid)
+{
+    std::lock_guard<std::mutex> guard(_queryLock);
+    _queryProcessor.AddCallback(CharacterDatabase.AsyncQuery(Acore::StringFormatFmt("SELECT enabled_time, fallen_time, fallen_level FROM character_challenge_modes WHERE guid = {}", guid.GetCounter()))
+        .WithCallback([this, guid](QueryResult result) { OnRecordLoaded(guid, result); }));
+}
+
+void ChallengeModes::OnRecordLoaded(ObjectGuid guid, QueryResult result)
+{
+    ChallengeModeCharacterRecord record;
+    if (result)
+    {
+        Field* fields = result->Fetch();
+        record.enabledTime = fields[0].Get<uint32>();
+        record.fallenTime  = fields[1].Get<uint32>();
+        record.fallenLevel = fields[2].Get<uint8>();
+    }
+
+    // The character may already be in the world if the query was slower than the login
+    if (Player* player = ObjectAccessor::FindConnectedPlayer(guid))
+    {
+        if (ChallengeModePlayerData* data = GetPlayerData(player))
+        {
+            // Values set since the login are newer than the loaded ones, except the first enable time
+            if (!record.enabledTime)
+            {
+                record.enabledTime = data->record.enabledTime;
+            }
+            if (data->record.fallenTime)
+            {
+                record.fallenTime = data->record.fallenTime;
+                record.fallenLevel = data->record.fallenLevel;
+            }
+            data->record = record;
+            data->recordLoaded = true;
+            sChallengeModesRegistry->Sync(player);
+
+            std::lock_guard<std::mutex> guard(_prefetchLock);
+            _prefetched.erase(guid.GetCounter());
+            return;
+        }
+    }
+
+    std::lock_guard<std::mutex> guard(_prefetchLock);
+    auto itr = _prefetched.find(guid.GetCounter());
+    if (itr != _prefetched.end())
+    {
+        itr->second.ready = true;
+        itr->second.record = record;
+    }
+}
+
+void ChallengeModes::HydratePlayerData(Player* player)
+{
+    // Characters of a disabled module get no state, the public API falls back to their settings
+    if (!enabled())
+    {
+        return;
+    }
+
+    auto data = new ChallengeModePlayerData();
+    data->activeMask = LoadActiveChallengeMask(player);
+    data->dirty = player->GetPlayerSetting("mod-challenge-modes", PLAYER_SETTING_MARK_DIRTY).value == 1;
+    data->fallen = player->GetPlayerSetting("mod-challenge-modes", PLAYER_SETTING_FALLEN).value == 1;
+    data->levelStartTime = player->GetTotalPlayedTime() - player->GetLevelPlayedTime();
+
+    bool pending = false;
+    {
+        std::lock_guard<std::mutex> guard(_prefetchLock);
+        auto itr = _prefetched.find(player->GetGUID().GetCounter());
+        if (itr != _prefetched.end())
+        {
+            if (itr->second.ready)
+            {
+                data->record = itr->second.record;
+                data->recordLoaded = true;
+                _prefetched.erase(itr);
+            }
+            else
+            {
+                // Applied by OnRecordLoaded once the query completes
+                pending = true;
+            }
+        }
+    }
+
+    player->CustomData.Set("ChallengeModes", data);
+    sChallengeModesRegistry->Sync(player);
+    SyncEnchantmentRule(player);
+    LoadItemProvenance(player);
+
+    // The login packet was not seen (e.g. the state was dropped by a config reload), load the record in the background.
+    if (!data->recordLoaded && !pending)
+    {
+        LoadRecord(player->GetGUID());
+    }
+}
+
+void ChallengeModes::ProcessQueryCallbacks()
+{
+    {
+        std::lock_guard<std::mutex> guard(_queryLock);
+        _queryProcessor.ProcessReadyCallbacks();
+    }
+
+    // Drop records of logins that never completed
+    std::lock_guard<std::mutex> guard(_prefetchLock);
+    for (auto itr = _prefetched.begin(); itr != _prefetched.end();)
+    {
+        if (itr->second.ready && GetMSTimeDiffToNow(itr->second.requestTime) > 5 * MINUTE * IN_MILLISECONDS)
+        {
+            itr = _prefetched.erase(itr);
+        }
+        else
+        {
+            ++itr;
+        }
+    }
+}
+
+bool ChallengeModes::TryMarkFallen(Player* player)
+{
+    if (isFallen(player))
+    {
+        return true;
+    }
+
+    uint32 permadeathMask = ChallengeRuleMask(CHALLENGE_RULE_PERMADEATH);
+    for (uint8 i = 0; i < SETTING_MODE_MAX; ++i)
+    {
+        auto setting = ChallengeModeSettings(i);
+        if ((permadeathMask & ChallengeMask(setting)) && challengeEnabledForPlayer(setting, player))
+        {
+            SetPlayerSetting(player, PLAYER_SETTING_FALLEN, 1);
+            if (ChallengeModePlayerData* data = GetPlayerData(player))
+            {
+                data->record.fallenTime = GameTime::GetGameTime().count();
+                data->record.fallenLevel = player->GetLevel();
+                SaveFallen(player->GetGUID(), data->record.fallenTime, data->record.fallenLevel);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+void ChallengeModes::RevivePlayer(Player* player)
+{
+    SetPlayerSetting(player, PLAYER_SETTING_FALLEN, 0);
+
+    ChallengeModePlayerData* data = GetPlayerData(player);
+    if (data)
+    {
+        data->record.fallenTime = 0;
+        data->record.fallenLevel = 0;
+        sChallengeModesRegistry->Sync(player);
+    }
+
+    if (player->IsAlive())
+    {
+        return;
+    }
+
+    if (data)
+    {
+        data->reviving = true;
+    }
+    player->ResurrectPlayer(1.0f);
+    player->SpawnCorpseBones();
+    if (data)
+    {
+        data->reviving = false;
+    }
+}
+
+void ChallengeModes::QueueFallen(Player* player)
+{
+    if (fallenMode == FALLEN_MODE_NONE)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(_fallenLock);
+    _fallenQueue.emplace_back(player->GetGUID(), fallenGraceTime);
+}
+
+void ChallengeModes::UpdateFallen(uint32 diff)
+{
+    std::vector<ObjectGuid> expired;
+    {
+        std::lock_guard<std::mutex> guard(_fallenLock);
+        if (_fallenQueue.empty())
+        {
+            return;
+        }
+
+        for (auto itr = _fallenQueue.begin(); itr != _fallenQueue.end();)
+        {
+            if (itr->second > diff)
+            {
+                itr->second -= diff;
+                ++itr;
+                continue;
+            }
+            expired.push_back(itr->first);
+            itr = _fallenQueue.erase(itr);
+        }
+    }
+
+    for (ObjectGuid const& guid : expired)
+    {
+        Player* player = ObjectAccessor::FindPlayer(guid);
+        if (!player || !isFallen(player))
+        {
+            continue;
+        }
+
+        switch (fallenMode)
+        {
+            case FALLEN_MODE_TELEPORT:
+                if (player->GetMapId() != fallenMapId)
+                {
+                    ChatHandler(player->GetSession()).SendSysMessage("Your challenge has ended. Your spirit has been moved to rest.");
+                    player->TeleportTo(fallenMapId, fallenPositionX, fallenPositionY, fallenPositionZ, fallenOrientation);
+                }
+                break;
+            case FALLEN_MODE_LOGOUT:
+                player->GetSession()->KickPlayer("mod-challenge-modes: fallen character");
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+uint32 ChallengeModes::GetActiveRuleFlags(Player* player) const
+{
+    return ChallengeRuleFlags(GetRestrictedChallengeMask(player));
+}
+
+bool ChallengeModes::IsSelfCraftedItem(Player* player, Item* item)
+{
+    ItemTemplate const* proto = item->GetTemplate();
+
+    // Allow fishing poles to be equipped since you cannot craft them.
+    if (proto->Class == ITEM_CLASS_WEAPON && proto->SubClass == ITEM_SUBCLASS_WEAPON_FISHING_POLE)
+    {
+        return true;
+    }
+
+    if (!proto->HasSignature())
+    {
+        // Crafted items without a signature, e.g. bags and ammunition, are known from the provenance
+        ChallengeModePlayerData const* data = GetPlayerData(player);
+        return data && data->provenance.Find(item->GetGUID().GetCounter()) == ITEM_SOURCE_CRAFTED;
+    }
+    return item->GetGuidValue(ITEM_FIELD_CREATOR) == player->GetGUID();
+}
+
+bool ChallengeModes::HasItemProvenance(Player* player, Item* item)
+{
+    ChallengeModePlayerData const* data = GetPlayerData(player);
+    return data && data->provenance.Find(item->GetGUID().GetCounter()) != ITEM_SOURCE_NONE;
+}
+
+bool ChallengeModes::IsSelfFoundItem(Player* player, Item* item)
+{
+    ChallengeModePlayerData const* data = GetPlayerData(player);
+    // Nothing is known about the items until the provenance is loaded, they are refused meanwhile like the unsigned
+    // items of IsSelfCraftedItem. Items equipped while the character loads are left to the compliance audit.
+    if (!data || !data->provenanceLoaded)
+    {
+        return false;
+    }
+
+    switch (data->provenance.Find(item->GetGUID().GetCounter()))
+    {
+        case ITEM_SOURCE_STARTING:
+        case ITEM_SOURCE_LOOTED:
+        case ITEM_SOURCE_CRAFTED:
+        case ITEM_SOURCE_QUEST:
+        case ITEM_SOURCE_VENDOR:
+        case ITEM_SOURCE_OTHER:
+        case ITEM_SOURCE_REWARD:
+            return true;
+        default:
+            return false;
+    }
+}
+
+void ChallengeModes::RecordItemSource(Player* player, Item* item, ChallengeItemSource source)
+{
+    if (!item || !(GetActiveRuleFlags(player) & CHALLENGE_PROVENANCE_RULES))
+    {
+        return;
+    }
+
+    ChallengeModePlayerData* data = GetPlayerData(player);
+    if (!data)
+    {
+        return;
+    }
+
+    uint32 itemGuid = item->GetGUID().GetCounter();
+    if (data->provenance.Find(itemGuid) != source)
+    {
+        data->provenance.Set(itemGuid, source);
+        data->pendingProvenance.push_back(itemGuid);
+    }
+}
+
+void ChallengeModes::RecordOwnedItems(Player* player, ChallengeItemSource source)
+{
+    ChallengeModePlayerData* data = GetPlayerData(player);
+    if (!data)
+    {
+        return;
+    }
+
+    auto record = [data, source](Item* item)
+    {
+        uint32 itemGuid = item->GetGUID().GetCounter();
+        if (data->provenance.Find(itemGuid) == ITEM_SOURCE_NONE)
+        {
+            data->provenance.Set(itemGuid, source);
+            data->pendingProvenance.push_back(itemGuid);
+        }
+    };
+
+    for (uint8 slot = EQUIPMENT_SLOT_START; slot < INVENTORY_SLOT_ITEM_END; ++slot)
+    {
+        if (Item* item = player->GetItemByPos(INVENTORY_SLOT_BAG_0, slot))
+        {
+            record(item);
+        }
+    }
+
+    for (uint8 bagSlot = INVENTORY_SLOT_BAG_START; bagSlot < INVENTORY_SLOT_BAG_END; ++bagSlot)
+    {
+        if (Bag* bag = player->GetBagByPos(bagSlot))
+        {
+            for (uint32 slot = 0; slot < bag->GetBagSize(); ++slot)
+            {
+                if (Item* item = bag->GetItemByPos(slot))
+                {
+                    record(item);
+                }
+            }
+        }
+    }
+    data->provenanceLoaded = true;
+}
+
+void ChallengeModes::SaveItemProvenance(Player* player)
+{
+    ChallengeModePlayerData* data = GetPlayerData(player);
+    if (!data || data->pendingProvenance.empty())
+    {
+        return;
+    }
+
+    // Items that left the character since they were recorded are not written, and are dropped from the table
+    // once it grows, so it only holds what the character owns. Rewards are stored when they are mailed and kept,
+    // they may still be in the mailbox.
+    CharacterDatabaseTransaction trans = CharacterDatabase.BeginTransaction();
+    for (uint32 itemGuid : data->pendingProvenance)
+    {
+        if (player->GetItemByGuid(ObjectGuid::Create<HighGuid::Item>(itemGuid)))
+        {
+            trans->Append("REPLACE INTO character_challenge_item_provenance (item_guid, owner_guid, source) VALUES ({}, {}, {})",
+                itemGuid, player->GetGUID().GetCounter(), uint32(data->provenance.Find(itemGuid)));
+        }
+    }
+    CharacterDatabase.CommitTransaction(trans);
+    data->pendingProvenance.clear();
+
+    static constexpr size_t CompactSize = 256;
+    if (data->provenance.Size() > CompactSize)
+    {
+        ChallengeItemProvenanceTable owned;
+        data->provenance.ForEach([&owned, player](uint32 itemGuid, ChallengeItemSource source)
+        {
+            if (source == ITEM_SOURCE_REWARD || player->GetItemByGuid(ObjectGuid::Create<HighGuid::Item>(itemGuid)))
+            {
+                owned.Set(itemGuid, source);
+            }
+        });
+        data->provenance = std::move(owned);
+    }
+}
+
+void ChallengeModes::SendRewardItem(Player* player, uint32 itemEntry)
+{
+    // The mail of Player::SendItemRetrievalMail. The item is created here, so its provenance is stored with the mail
+    // and Self-Found characters can equip it once they take it.
+    CharacterDatabaseTransaction trans = CharacterDatabase.BeginTransaction();
+    MailDraft draft("Recovered Item", "We recovered a lost item in the twisting nether and noted that it was yours.$B$BPlease find said object enclosed.");
+    if (Item* item = Item::CreateItem(itemEntry, 1, nullptr))
+    {
+        item->SaveToDB(trans);
+        draft.AddItem(item);
+
+        ChallengeModePlayerData* data = GetPlayerData(player);
+        if (data && (GetActiveRuleFlags(player) & CHALLENGE_PROVENANCE_RULES))
+        {
+            data->provenance.Set(item->GetGUID().GetCounter(), ITEM_SOURCE_REWARD);
+            trans->Append("REPLACE INTO character_challenge_item_provenance (item_guid, owner_guid, source) VALUES ({}, {}, {})",
+                item->GetGUID().GetCounter(), player->GetGUID().GetCounter(), uint32(ITEM_SOURCE_REWARD));
+        }
+    }
+    draft.SendMailTo(trans, MailReceiver(player, player->GetGUID().GetCounter()), MailSender(MAIL_CREATURE, 34337));
+    CharacterDatabase.CommitTransaction(trans);
+}
+
+void ChallengeModes::StartProvenanceCleanup()
+{
+    _provenanceCleanupCursor = 0;
+    _provenanceCleanupEnd = 0;
+    if (QueryResult result = CharacterDatabase.Query("SELECT IFNULL(MAX(item_guid), 0) FROM character_challenge_item_provenance"))
+    {
+        _provenanceCleanupEnd = result->Fetch()[0].Get<uint32>();
+    }
+}
+
+void ChallengeModes::UpdateProvenanceCleanup(uint32 diff)
+{
+    if (_provenanceCleanupPending || _provenanceCleanupCursor >= _provenanceCleanupEnd)
+    {
+        return;
+    }
+
+    if (_provenanceCleanupTimer > diff)
+    {
+        _provenanceCleanupTimer -= diff;
+        return;
+    }
+    _provenanceCleanupTimer = ProvenanceCleanupInterval;
+
+    // One primary key range per batch. Items that were destroyed, sold or mailed away since their provenance was
+    // stored have no item_instance row anymore.
+    _provenanceCleanupPending = true;
+    std::lock_guard<std::mutex> guard(_queryLock);
+    _queryProcessor.AddCallback(CharacterDatabase.AsyncQuery(Acore::StringFormatFmt("SELECT p.item_guid, IFNULL(i.guid, 0) FROM character_challenge_item_provenance p "
+        "LEFT JOIN item_instance i ON i.guid = p.item_guid WHERE p.item_guid > {} AND p.item_guid <= {} ORDER BY p.item_guid LIMIT {}",
+        _provenanceCleanupCursor, _provenanceCleanupEnd, ProvenanceCleanupBatchSize))
+        .WithCallback([this](QueryResult result)
+        {
+            _provenanceCleanupPending = false;
+            if (!result)
+            {
+                _provenanceCleanupCursor = _provenanceCleanupEnd;
+                return;
+            }
+
+            std::string orphans;
+            do
+            {
+                Field* fields = result->Fetch();
+                _provenanceCleanupCursor = fields[0].Get<uint32>();
+                if (!fields[1].Get<uint32>())
+                {
+                    orphans += (orphans.empty() ? "" : ",") + std::to_string(_provenanceCleanupCursor);
+                }
+            } while (result->NextRow());
+
+            if (result->GetRowCount() < ProvenanceCleanupBatchSize)
+            {
+                _provenanceCleanupCursor = _provenanceCleanupEnd;
+            }
+
+            if (!orphans.empty())
+            {
+                CharacterDatabase.Execute("DELETE FROM character_challenge_item_provenance WHERE item_guid IN ({})", orphans);
+            }
+        }));
+}
+
+void ChallengeModes::LoadItemProvenance(Player* player)
+{
+    ChallengeModePlayerData* data = GetPlayerData(player);
+    if (!data)
+    {
+        return;
+    }
+
+    // Characters without a provenance rule have nothing stored, and start recording when such a challenge is enabled
+    if (!(GetActiveRuleFlags(player) & CHALLENGE_PROVENANCE_RULES))
+    {
+        data->provenanceLoaded = true;
+        return;
+    }
+
+    ObjectGuid guid = player->GetGUID();
+    std::lock_guard<std::mutex> guard(_queryLock);
+    _queryProcessor.AddCallback(CharacterDatabase.AsyncQuery(Acore::StringFormatFmt("SELECT item_guid, source FROM character_challenge_item_provenance WHERE owner_guid = {}", guid.GetCounter()))
+        .WithCallback([guid](QueryResult result)
+        {
+            Player* player = ObjectAccessor::FindConnectedPlayer(guid);
+            ChallengeModePlayerData* data = player ? GetPlayerData(player) : nullptr;
+            if (!data)
+            {
+                return;
+            }
+
+            if (result)
+            {
+                do
+                {
+                    Field* fields = result->Fetch();
+                    uint32 itemGuid = fields[0].Get<uint32>();
+                    uint8 source = fields[1].Get<uint8>();
+                    // Items recorded since the login are newer than the stored rows
+                    if (source < ITEM_SOURCE_MAX && data->provenance.Find(itemGuid) == ITEM_SOURCE_NONE)
+                    {
+                        data->provenance.Set(itemGuid, ChallengeItemSource(source));
+                    }
+                } while (result->NextRow());
+            }
+            data->provenanceLoaded = true;
+        }));
+}
+
+bool ChallengeModes::IsLowQualityItem(ItemTemplate const* proto)
+{
+    return proto->Quality <= ITEM_QUALITY_NORMAL;
+}
+
+bool ChallengeModes::IsForbiddenTradeSkill(uint32 spellId)
+{
+    // These professions are class skills so they are always acceptable
+    switch (spellId)
+    {
+        case RUNEFORGING:
+        case POISONS:
+        case BEAST_TRAINING:
+            return false;
+        default:
+            break;
+    }
+
+    SpellInfo const* spellInfo = sSpellMgr->GetSpellInfo(spellId);
+    if (!spellInfo)
+    {
+        return false;
+    }
+    for (uint8 i = 0; i < 3; i++)
+    {
+        if (spellInfo->Effects[i].Effect == SPELL_EFFECT_TRADE_SKILL)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ChallengeModes::IsForbiddenConsumable(ItemTemplate const* proto)
+{
+    // Do not allow using elixir, potion, or flask
+    if (proto->Class == ITEM_CLASS_CONSUMABLE &&
+            (proto->SubClass == ITEM_SUBCLASS_POTION ||
+            proto->SubClass == ITEM_SUBCLASS_ELIXIR ||
+            proto->SubClass == ITEM_SUBCLASS_FLASK))
+    {
+        return true;
+    }
+    // Do not allow food that gives food buffs
+    if (proto->Class == ITEM_CLASS_CONSUMABLE && proto->SubClass == ITEM_SUBCLASS_FOOD)
+    {
+        for (const auto & Spell : proto->Spells)
+        {
+            SpellInfo const* spellInfo = sSpellMgr->GetSpellInfo(Spell.SpellId);
+            if (!spellInfo)
+                continue;
+
+            for (uint8 i = 0; i < 3; i++)
+            {
+                if (spellInfo->Effects[i].ApplyAuraName == SPELL_AURA_PERIODIC_TRIGGER_SPELL)
+                {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+bool ChallengeModes::ParseChallengeName(std::string_view name, ChallengeModeSettings& setting)
+{
+    // Accepts the config prefix or the display name, ignoring case, spaces and dashes ("ironman", "Iron Man", "semi-hardcore")
+    auto normalize = [](std::string_view value)
+    {
+        std::string normalized;
+        for (char c : value)
+        {
+            if (c != ' ' && c != '-')
+            {
+                normalized += std::tolower(static_cast<unsigned char>(c));
+            }
+        }
+        return normalized;
+    };
+
+    std::string const input = normalize(name);
+    for (uint8 i = 0; i < SETTING_MODE_MAX; ++i)
+    {
+        if (input == normalize(ChallengeModeDescriptors[i].configPrefix) || input == normalize(ChallengeModeDescriptors[i].name))
+        {
+            setting = ChallengeModeSettings(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string ChallengeModes::GetChallengeNameFromEnum(uint8 value)
+{
+    if (value >= SETTING_MODE_MAX)
+    {
+        return "ERROR";
+    }
+    return ChallengeModeDescriptors[value].name;
+}
+
+uint32 ChallengeModes::LoadActiveChallengeMask(Player* player)
+{
+    uint32 mask = 0;
+    for (uint8 i = 0; i < SETTING_MODE_MAX; ++i)
+    {
+        if (player->GetPlayerSetting("mod-challenge-modes", ChallengePlayerSettingIndex(ChallengeModeSettings(i))).value == 1)
+        {
+            mask |= ChallengeMask(ChallengeModeSettings(i));
+        }
+    }
+    return mask;
+}
+
+void ChallengeModes::BuildGossipMenus()
+{
+    for (uint32 activeMask = 0; activeMask < CHALLENGE_MASK_COUNT; ++activeMask)
+    {
+        ChallengeGossipMenu& menu = gossipMenus[activeMask];
+        menu.selectableMask = 0;
+        menu.options.clear();
+
+        if (!enabled())
+        {
+            continue;
+        }
+
+        for (uint8 i = 0; i < SETTING_MODE_MAX; ++i)
+        {
+            auto setting = ChallengeModeSettings(i);
+            if (challengeEnabled(setting) && !(activeMask & ChallengeConflictMatrix[setting]))
+            {
+                menu.selectableMask |= ChallengeMask(setting);
+                menu.options.push_back(setting);
+            }
+        }
+    }
+}
+
+void ChallengeModes::BuildInteractionPolicy()
+{
+    // Without the module no interaction is restricted and the policy is never looked up
+    if (!enabled())
+    {
+        interactionRestricted.fill(false);
+        return;
+    }
+
+    auto const start = std::chrono::steady_clock::now();
+    std::array<uint32, CHALLENGE_INTERACTION_MAX> restrictedMasks;
+    std::array<uint32, CHALLENGE_INTERACTION_MAX> exemptMasks;
+    for (uint8 interaction = 0; interaction < CHALLENGE_INTERACTION_MAX; ++interaction)
+    {
+        uint32 const ruleMask = ChallengeRuleMask(ChallengeInteractionDescriptors[interaction].ruleFlag);
+        restrictedMasks[interaction] = ruleMask & enabledChallengeMask;
+        exemptMasks[interaction] = GetSameChallengeExemptMask(ChallengeInteraction(interaction));
+        interactionRestricted[interaction] = (ruleMask & (enabledChallengeMask | sChallengeModesShadow->shadowMask)) != 0;
+    }
+
+    uint64 const inputsHash = ChallengeModesSnapshot::GetInputsHash(restrictedMasks, exemptMasks);
+    bool const loaded = sChallengeModesSnapshot->LoadInteractionPolicy(inputsHash);
+    if (!loaded)
+    {
+        for (uint8 interaction = 0; interaction < CHALLENGE_INTERACTION_MAX; ++interaction)
+        {
+            auto& policy = interactionPolicy[interaction];
+            for (uint32 initiatorMask = 0; initiatorMask < CHALLENGE_MASK_COUNT; ++initiatorMask)
+            {
+                for (uint32 targetMask = 0; targetMask < CHALLENGE_MASK_COUNT; ++targetMask)
+                {
+                    policy[initiatorMask * CHALLENGE_MASK_COUNT + targetMask] = ChallengeEvaluateInteraction(ChallengeInteraction(interaction),
+                        restrictedMasks[interaction], exemptMasks[interaction], initiatorMask, targetMask);
+                }
+            }
+        }
+        sChallengeModesSnapshot->MarkStale(inputsHash);
+    }
+
+    auto const elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    LOG_INFO("module", "Challenge Modes: interaction policy {} in {} us.", loaded ? "loaded from snapshot" : "built", elapsed);
+}
+
+static ChallengeShadowHook GetInteractionShadowHook(ChallengeInteraction interaction)
+{
+    switch (interaction)
+    {
+        case CHALLENGE_INTERACTION_TRADE:
+            return SHADOW_HOOK_TRADE;
+        case CHALLENGE_INTERACTION_MAIL:
+            return SHADOW_HOOK_MAIL;
+        case CHALLENGE_INTERACTION_GROUP:
+            return SHADOW_HOOK_GROUP;
+        case CHALLENGE_INTERACTION_AUCTION_HOUSE:
+            return SHADOW_HOOK_AUCTION_HOUSE;
+        default:
+            return SHADOW_HOOK_GUILD_BANK;
+    }
+}
+
+uint32 ChallengeModes::GetSameChallengeExemptMask(ChallengeInteraction interaction) const
+{
+    uint32 exemptMask = 0;
+    for (uint8 i = 0; i < SETTING_MODE_MAX; ++i)
+    {
+        if (challenges[i].sameChallengeInteractions & (1 << interaction))
+        {
+            exemptMask |= ChallengeMask(ChallengeModeSettings(i));
+        }
     }
+    return exemptMask;
 }
 
-bool ChallengeModes::challengeEnabledForPlayer(ChallengeModeSettings setting, Player* player) const
+bool ChallengeModes::CanInteract(Player* player, uint32 targetMask, ChallengeInteraction interaction)
 {
-    if (!enabled() || !challengeEnabled(setting))
+    uint32 initiatorMask = GetRestrictedChallengeMask(player);
+    ChallengeInteractionVerdict verdict = GetInteractionVerdict(interaction, initiatorMask, targetMask);
+    ChallengeInteractionDescriptor const& desc = ChallengeInteractionDescriptors[interaction];
+
+    if (sChallengeModesTrace->traceEnabled)
+    {
+        sChallengeModesTrace->RecordInteraction(player, initiatorMask, targetMask, interaction, verdict);
+    }
+
+    if (verdict != CHALLENGE_VERDICT_ALLOWED)
     {
+        uint8 blocking = (verdict & ~CHALLENGE_VERDICT_TARGET) - 1;
+        ChatHandler(player->GetSession()).PSendSysMessage((verdict & CHALLENGE_VERDICT_TARGET) ? desc.targetMessage : desc.initiatorMessage, ChallengeModeDescriptors[blocking].name);
         return false;
     }
-    return player->GetPlayerSetting("mod-challenge-modes", setting).value;
+
+    // Count the interaction as if the player had each shadowed challenge that forbids it and it does not have
+    uint32 shadowMask = sChallengeModesShadow->shadowMask & ChallengeRuleMask(desc.ruleFlag) & ~initiatorMask;
+    for (uint8 i = 0; shadowMask && i < SETTING_MODE_MAX; ++i)
+    {
+        auto setting = ChallengeModeSettings(i);
+        uint32 mask = ChallengeMask(setting);
+        if (!(shadowMask & mask) || !sChallengeModesShadow->IsShadowed(setting))
+        {
+            continue;
+        }
+
+        uint32 exemptMask = (challenges[i].sameChallengeInteractions & (1 << interaction)) ? mask : 0;
+        sChallengeModesShadow->Evaluate(setting, GetInteractionShadowHook(interaction), player, [&]
+        {
+            return ChallengeEvaluateInteraction(interaction, mask, exemptMask, initiatorMask | mask, targetMask) != CHALLENGE_VERDICT_ALLOWED;
+        });
+    }
+
+    return true;
 }
 
-std::string ChallengeModes::GetChallengeNameFromEnum(uint8 value)
+uint32 ChallengeModes::LoadChallengeMask(ObjectGuid guid, bool includeFallen) const
 {
-    switch (value)
-    {
-    case SETTING_HARDCORE:
-        return "Hardcore";
-    case SETTING_SEMI_HARDCORE:
-        return "Semi-Hardcore";
-    case SETTING_SELF_CRAFTED:
-        return "Self-Crafted";
-    case SETTING_ITEM_QUALITY_LEVEL:
-        return "Low Quality Items";
-    case SETTING_SLOW_XP_GAIN:
-        return "Slow XP";
-    case SETTING_VERY_SLOW_XP_GAIN:
-        return "Very Slow XP";
-    case SETTING_QUEST_XP_ONLY:
-        return "Quest XP Only";
-    case SETTING_IRON_MAN:
-        return "Iron Man";
-    }
-
-    return "ERROR";
-}
-
-bool ChallengeModes::challengeEnabled(ChallengeModeSettings setting) const
-{
-    switch (setting)
-    {
-        case SETTING_HARDCORE:
-            return hardcoreEnable;
-        case SETTING_SEMI_HARDCORE:
-            return semiHardcoreEnable;
-        case SETTING_SELF_CRAFTED:
-            return selfCraftedEnable;
-        case SETTING_ITEM_QUALITY_LEVEL:
-            return itemQualityLevelEnable;
-        case SETTING_SLOW_XP_GAIN:
-            return slowXpGainEnable;
-        case SETTING_VERY_SLOW_XP_GAIN:
-            return verySlowXpGainEnable;
-        case SETTING_QUEST_XP_ONLY:
-            return questXpOnlyEnable;
-        case SETTING_IRON_MAN:
-            return ironManEnable;
+    if (Player* player = ObjectAccessor::FindConnectedPlayer(guid))
+    {
+        return includeFallen ? GetRestrictedChallengeMask(player) : GetEnforcedChallengeMask(player);
     }
-    return false;
+
+    QueryResult result = CharacterDatabase.Query("SELECT data FROM character_settings WHERE guid = {} AND source = 'mod-challenge-modes'", guid.GetCounter());
+    if (!result)
+    {
+        return 0;
+    }
+
+    std::string data = result->Fetch()[0].Get<std::string>();
+    std::vector<std::string_view> tokens = Acore::Tokenize(data, ' ', false);
+
+    auto isSet = [&tokens](uint8 index) { return index < tokens.size() && Acore::StringTo<uint32>(tokens[index]).value_or(0) == 1; };
+    if (!includeFallen && isSet(PLAYER_SETTING_FALLEN))
+    {
+        return 0;
+    }
+
+    uint32 mask = 0;
+    for (uint8 i = 0; i < SETTING_MODE_MAX; ++i)
+    {
+        if (isSet(ChallengePlayerSettingIndex(ChallengeModeSettings(i))))
+        {
+            mask |= ChallengeMask(ChallengeModeSettings(i));
+        }
+    }
+    return mask & enabledChallengeMask;
+}
+
+static void LoadStringToMap(std::unordered_map<uint32, uint32> &mapToLoad, const std::string &configString)
+{
+    std::string delimitedValue;
+    std::stringstream configIdStream;
+
+    configIdStream.str(configString);
+    // Process each config ID in the string, delimited by the comma - "," and then space " "
+    while (std::getline(configIdStream, delimitedValue, ','))
+    {
+        std::string pairOne, pairTwo;
+        std::stringstream configPairStream(delimitedValue);
+        configPairStream>>pairOne>>pairTwo;
+        if (pairOne.empty())
+        {
+            continue;
+        }
+        auto configLevel = atoi(pairOne.c_str());
+        auto rewardValue = atoi(pairTwo.c_str());
+        mapToLoad[configLevel] = rewardValue;
+    }
+}
+
+static bool IsValidRewardLevel(std::string const& confName, uint32 level, uint32 rewardValue)
+{
+    if (level == 0 || level > DEFAULT_MAX_LEVEL)
+    {
+        LOG_ERROR("mod-challenge-modes", "{}: invalid level {} for reward {}, entry ignored.", confName, level, rewardValue);
+        return false;
+    }
+    return true;
 }
 
-float ChallengeModes::getXpBonusForChallenge(ChallengeModeSettings setting) const
-{
-    switch (setting)
-    {
-        case SETTING_HARDCORE:
-            return hardcoreXpBonus;
-        case SETTING_SEMI_HARDCORE:
-            return semiHardcoreXpBonus;
-        case SETTING_SELF_CRAFTED:
-            return selfCraftedXpBonus;
-        case SETTING_ITEM_QUALITY_LEVEL:
-            return itemQualityLevelXpBonus;
-        case SETTING_SLOW_XP_GAIN:
-            return 0.5f;
-        case SETTING_VERY_SLOW_XP_GAIN:
-            return 0.25f;
-        case SETTING_QUEST_XP_ONLY:
-            return questXpOnlyXpBonus;
-        case SETTING_IRON_MAN:
-            return 1;
-    }
-    return 1;
-}
-
-const std::unordered_map<uint8, uint32> *ChallengeModes::getTitleMapForChallenge(ChallengeModeSettings setting) const
-{
-    switch (setting)
-    {
-        case SETTING_HARDCORE:
-            return &hardcoreTitleRewards;
-        case SETTING_SEMI_HARDCORE:
-            return &semiHardcoreTitleRewards;
-        case SETTING_SELF_CRAFTED:
-            return &selfCraftedTitleRewards;
-        case SETTING_ITEM_QUALITY_LEVEL:
-            return &itemQualityLevelTitleRewards;
-        case SETTING_SLOW_XP_GAIN:
-            return &slowXpGainTitleRewards;
-        case SETTING_VERY_SLOW_XP_GAIN:
-            return &verySlowXpGainTitleRewards;
-        case SETTING_QUEST_XP_ONLY:
-            return &questXpOnlyTitleRewards;
-        case SETTING_IRON_MAN:
-            return &ironManTitleRewards;
-    }
-    return {};
-}
-
-const std::unordered_map<uint8, uint32> *ChallengeModes::getTalentMapForChallenge(ChallengeModeSettings setting) const
-{
-    switch (setting)
-    {
-        case SETTING_HARDCORE:
-            return &hardcoreTalentRewards;
-        case SETTING_SEMI_HARDCORE:
-            return &semiHardcoreTalentRewards;
-        case SETTING_SELF_CRAFTED:
-            return &selfCraftedTalentRewards;
-        case SETTING_ITEM_QUALITY_LEVEL:
-            return &itemQualityLevelTalentRewards;
-        case SETTING_SLOW_XP_GAIN:
-            return &slowXpGainTalentRewards;
-        case SETTING_VERY_SLOW_XP_GAIN:
-            return &verySlowXpGainTalentRewards;
-        case SETTING_QUEST_XP_ONLY:
-            return &questXpOnlyTalentRewards;
-        case SETTING_IRON_MAN:
-            return &ironManTalentRewards;
-    }
-    return {};
-}
-
-const std::unordered_map<uint8, uint32> *ChallengeModes::getItemMapForChallenge(ChallengeModeSettings setting) const
-{
-    switch (setting)
-    {
-        case SETTING_HARDCORE:
-            return &hardcoreItemRewards;
-        case SETTING_SEMI_HARDCORE:
-            return &semiHardcoreItemRewards;
-        case SETTING_SELF_CRAFTED:
-            return &selfCraftedItemRewards;
-        case SETTING_ITEM_QUALITY_LEVEL:
-            return &itemQualityLevelItemRewards;
-        case SETTING_SLOW_XP_GAIN:
-            return &slowXpGainItemRewards;
-        case SETTING_VERY_SLOW_XP_GAIN:
-            return &verySlowXpGainItemRewards;
-        case SETTING_QUEST_XP_ONLY:
-            return &questXpOnlyItemRewards;
-        case SETTING_IRON_MAN:
-            return &ironManItemRewards;
-    }
-    return {};
+void ChallengeModes::LoadRewards()
+{
+    uint32 loaded = 0;
+    uint32 rejected = 0;
+
+    for (uint8 i = 0; i < SETTING_MODE_MAX; ++i)
+    {
+        ChallengeModeDescriptor const& desc = ChallengeModeDescriptors[i];
+        ChallengeModeConfig& config = challenges[i];
+        config.titleRewards.clear();
+        config.talentRewards.clear();
+        config.itemRewards.clear();
+
+        if (!desc.compiled)
+        {
+            continue;
+        }
+
+        std::string confName = std::string(desc.configPrefix) + ".TitleRewards";
+        std::unordered_map<uint32, uint32> configMap;
+        LoadStringToMap(configMap, sConfigMgr->GetOption<std::string>(confName, ""));
+        for (auto const& [level, titleId] : configMap)
+        {
+            if (!IsValidRewardLevel(confName, level, titleId))
+            {
+                ++rejected;
+                continue;
+            }
+            CharTitlesEntry const* titleInfo = sCharTitlesStore.LookupEntry(titleId);
+            if (!titleInfo)
+            {
+                LOG_ERROR("mod-challenge-modes", "{}: level {} references invalid title ID {}, entry ignored.", confName, level, titleId);
+                ++rejected;
+                continue;
+            }
+            config.titleRewards[level] = titleInfo;
+            ++loaded;
+        }
+
+        confName = std::string(desc.configPrefix) + ".TalentRewards";
+        configMap.clear();
+        LoadStringToMap(configMap, sConfigMgr->GetOption<std::string>(confName, ""));
+        for (auto const& [level, talentPoints] : configMap)
+        {
+            if (!IsValidRewardLevel(confName, level, talentPoints))
+            {
+                ++rejected;
+                continue;
+            }
+            if (talentPoints == 0)
+            {
+                LOG_ERROR("mod-challenge-modes", "{}: level {} rewards no talent points, entry ignored.", confName, level);
+                ++rejected;
+                continue;
+            }
+            config.talentRewards[level] = talentPoints;
+            ++loaded;
+        }
+
+        confName = std::string(desc.configPrefix) + ".ItemRewards";
+        configMap.clear();
+        LoadStringToMap(configMap, sConfigMgr->GetOption<std::string>(confName, ""));
+        for (auto const& [level, itemEntry] : configMap)
+        {
+            if (!IsValidRewardLevel(confName, level, itemEntry))
+            {
+                ++rejected;
+                continue;
+            }
+            if (!sObjectMgr->GetItemTemplate(itemEntry))
+            {
+                LOG_ERROR("mod-challenge-modes", "{}: level {} references invalid item ID {}, entry ignored.", confName, level, itemEntry);
+                ++rejected;
+                continue;
+            }
+            config.itemRewards[level] = itemEntry;
+            ++loaded;
+        }
+    }
+
+    if (rejected)
+    {
+        LOG_ERROR("mod-challenge-modes", "Loaded {} challenge mode rewards, rejected {} invalid entries. Check the reward options in challenge_modes.conf.", loaded, rejected);
+    }
+    else
+    {
+        LOG_INFO("module", "Loaded {} challenge mode rewards.", loaded);
+    }
 }
 
 class ChallengeModes_WorldScript : public WorldScript
@@ -186,305 +1197,515 @@ public:
         : WorldScript("ChallengeModes_WorldScript")
     {}
 
-    void OnBeforeConfigLoad(bool /*reload*/) override
+    void OnBeforeConfigLoad(bool reload) override
     {
         LoadConfig();
+
+        // On the first load the DBC and item template stores are not loaded yet, rewards are resolved in OnStartup.
+        if (reload)
+        {
+            sChallengeModes->LoadRewards();
+        }
     }
 
-private:
-    static void LoadStringToMap(std::unordered_map<uint8, uint32> &mapToLoad, const std::string &configString)
+    void OnStartup() override
+    {
+        sChallengeModes->LoadRewards();
+        sChallengeModes->StartProvenanceCleanup();
+    }
+
+    void OnUpdate(uint32 diff) override
     {
-        std::string delimitedValue;
-        std::stringstream configIdStream;
+        sChallengeModes->ProcessQueryCallbacks();
+        sChallengeModesAdmin->ProcessQueryCallbacks();
+        sChallengeModes->UpdateFallen(diff);
+        sChallengeModes->UpdateProvenanceCleanup(diff);
+        sChallengeModesAuditor->Update(diff);
+        sChallengeModesAnnouncer->Update(diff);
+        sChallengeModesTelemetry->Update(diff);
+        sChallengeModesTrace->Update(diff);
+    }
 
-        configIdStream.str(configString);
-        // Process each config ID in the string, delimited by the comma - "," and then space " "
-        while (std::getline(configIdStream, delimitedValue, ','))
+    void OnShutdown() override
+    {
+        sChallengeModesTrace->Stop();
+        sChallengeModesSnapshot->Save();
+        if (sChallengeModesTelemetry->telemetryEnabled)
         {
-            std::string pairOne, pairTwo;
-            std::stringstream configPairStream(delimitedValue);
-            configPairStream>>pairOne>>pairTwo;
-            auto configLevel = atoi(pairOne.c_str());
-            auto rewardValue = atoi(pairTwo.c_str());
-            mapToLoad[configLevel] = rewardValue;
+            sChallengeModesTelemetry->Flush();
         }
     }
 
+private:
     static void LoadConfig()
     {
         sChallengeModes->challengesEnabled = sConfigMgr->GetOption<bool>("ChallengeModes.Enable", false);
+        sChallengeModes->enabledChallengeMask = 0;
+        sChallengeModesShadow->shadowMask = 0;
         if (sChallengeModes->enabled())
         {
-            for (auto& [confName, rewardMap] : sChallengeModes->rewardConfigMap)
+            for (uint8 i = 0; i < SETTING_MODE_MAX; ++i)
+            {
+                ChallengeModeDescriptor const& desc = ChallengeModeDescriptors[i];
+                ChallengeModeConfig& config = sChallengeModes->challenges[i];
+                config.sameChallengeInteractions = 0;
+                if (!desc.compiled)
+                {
+                    config.enabled = false;
+                    continue;
+                }
+
+                std::string prefix = desc.configPrefix;
+                config.enabled = sConfigMgr->GetOption<bool>(prefix + ".Enable", true);
+                config.xpMultiplier = desc.xpMultiplierConfigurable ? sConfigMgr->GetOption<float>(prefix + ".XPMultiplier", desc.defaultXpMultiplier) : desc.defaultXpMultiplier;
+                if (config.enabled)
+                {
+                    sChallengeModes->enabledChallengeMask |= ChallengeMask(ChallengeModeSettings(i));
+                }
+                LoadSameChallengeInteractions(prefix + ".SameChallengeInteractions", config);
+                if (sConfigMgr->GetOption<bool>(prefix + ".Shadow", false))
+                {
+                    sChallengeModesShadow->shadowMask |= ChallengeMask(ChallengeModeSettings(i));
+                }
+            }
+        }
+
+        sChallengeModes->fallenMode        = ChallengeFallenMode(sConfigMgr->GetOption<uint32>("ChallengeModes.Fallen.Mode", FALLEN_MODE_NONE));
+        sChallengeModes->fallenGraceTime   = sConfigMgr->GetOption<uint32>("ChallengeModes.Fallen.GraceTime", 60) * IN_MILLISECONDS;
+        sChallengeModes->fallenMapId       = sConfigMgr->GetOption<uint32>("ChallengeModes.Fallen.MapId", 1);
+        sChallengeModes->fallenPositionX   = sConfigMgr->GetOption<float>("ChallengeModes.Fallen.PositionX", 16226.2f);
+        sChallengeModes->fallenPositionY   = sConfigMgr->GetOption<float>("ChallengeModes.Fallen.PositionY", 16257.0f);
+        sChallengeModes->fallenPositionZ   = sConfigMgr->GetOption<float>("ChallengeModes.Fallen.PositionZ", 13.2f);
+        sChallengeModes->fallenOrientation = sConfigMgr->GetOption<float>("ChallengeModes.Fallen.Orientation", 1.65f);
+        if (sChallengeModes->fallenMode > FALLEN_MODE_LOGOUT)
+        {
+            LOG_ERROR("mod-challenge-modes", "ChallengeModes.Fallen.Mode {} is invalid, fallen characters will not be moved.", uint32(sChallengeModes->fallenMode));
+            sChallengeModes->fallenMode = FALLEN_MODE_NONE;
+        }
+
+        sChallengeModesAuditor->auditEnabled = sConfigMgr->GetOption<bool>("ChallengeModes.Audit.Enable", true);
+        sChallengeModesAuditor->budget       = std::max<uint32>(sConfigMgr->GetOption<uint32>("ChallengeModes.Audit.BudgetMicroseconds", 200), 1);
+        sChallengeModesAuditor->interval     = sConfigMgr->GetOption<uint32>("ChallengeModes.Audit.Interval", 60) * IN_MILLISECONDS;
+
+        sChallengeModesAnnouncer->channel     = ChallengeAnnounceChannel(sConfigMgr->GetOption<uint32>("ChallengeModes.Announce.Channel", ANNOUNCE_CHANNEL_NONE));
+        sChallengeModesAnnouncer->interval    = sConfigMgr->GetOption<uint32>("ChallengeModes.Announce.Interval", 5) * IN_MILLISECONDS;
+        sChallengeModesAnnouncer->maxMessages = sConfigMgr->GetOption<uint32>("ChallengeModes.Announce.MaxMessages", 3);
+        if (sChallengeModesAnnouncer->channel > ANNOUNCE_CHANNEL_GUILD)
+        {
+            LOG_ERROR("mod-challenge-modes", "ChallengeModes.Announce.Channel {} is invalid, announcements are disabled.", uint32(sChallengeModesAnnouncer->channel));
+            sChallengeModesAnnouncer->channel = ANNOUNCE_CHANNEL_NONE;
+        }
+        if (!sChallengeModes->enabled())
+        {
+            sChallengeModesAnnouncer->channel = ANNOUNCE_CHANNEL_NONE;
+        }
+
+        sChallengeModesTelemetry->telemetryEnabled = sChallengeModes->enabled() && sConfigMgr->GetOption<bool>("ChallengeModes.Telemetry.Enable", false);
+        sChallengeModesTelemetry->SetInterval(std::max<uint32>(sConfigMgr->GetOption<uint32>("ChallengeModes.Telemetry.Interval", 3600), 60) * IN_MILLISECONDS);
+
+        sChallengeModesSnapshot->snapshotEnabled = sConfigMgr->GetOption<bool>("ChallengeModes.Snapshot.Enable", true);
+        sChallengeModesSnapshot->path            = sConfigMgr->GetOption<std::string>("ChallengeModes.Snapshot.File", "challenge_modes.snapshot");
+
+        sChallengeModes->BuildGossipMenus();
+        sChallengeModes->BuildInteractionPolicy();
+
+        // The trace header holds the XP multipliers and same-challenge exceptions, so it is restarted after they are loaded
+        sChallengeModesTrace->bufferSize = sConfigMgr->GetOption<uint32>("ChallengeModes.Trace.BufferSize", 65536);
+        sChallengeModesTrace->Restart(sChallengeModes->enabled() && sConfigMgr->GetOption<bool>("ChallengeModes.Trace.Enable", false),
+            sConfigMgr->GetOption<std::string>("ChallengeModes.Trace.File", "challenge_modes.trace"));
+
+        // A reload can enable or disable the no-enchantments rule for characters that are online
+        sChallengeModes->SyncEnchantmentRules();
+    }
+
+    static void LoadSameChallengeInteractions(std::string const& confName, ChallengeModeConfig& config)
+    {
+        std::string value = sConfigMgr->GetOption<std::string>(confName, "");
+        for (std::string_view token : Acore::Tokenize(value, ',', false))
+        {
+            size_t first = token.find_first_not_of(' ');
+            if (first == std::string_view::npos)
             {
-                rewardMap->clear();
-                LoadStringToMap(*rewardMap, sConfigMgr->GetOption<std::string>(confName, ""));
+                continue;
             }
+            token = token.substr(first, token.find_last_not_of(' ') - first + 1);
 
-            sChallengeModes->hardcoreEnable          = sConfigMgr->GetOption<bool>("Hardcore.Enable", true);
-            sChallengeModes->semiHardcoreEnable      = sConfigMgr->GetOption<bool>("SemiHardcore.Enable", true);
-            sChallengeModes->selfCraftedEnable       = sConfigMgr->GetOption<bool>("SelfCrafted.Enable", true);
-            sChallengeModes->itemQualityLevelEnable  = sConfigMgr->GetOption<bool>("ItemQualityLevel.Enable", true);
-            sChallengeModes->slowXpGainEnable        = sConfigMgr->GetOption<bool>("SlowXpGain.Enable", true);
-            sChallengeModes->verySlowXpGainEnable    = sConfigMgr->GetOption<bool>("VerySlowXpGain.Enable", true);
-            sChallengeModes->questXpOnlyEnable       = sConfigMgr->GetOption<bool>("QuestXpOnly.Enable", true);
-            sChallengeModes->ironManEnable           = sConfigMgr->GetOption<bool>("IronMan.Enable", true);
+            uint8 interaction = 0;
+            while (interaction < CHALLENGE_INTERACTION_MAX && token != ChallengeInteractionDescriptors[interaction].name)
+            {
+                ++interaction;
+            }
 
-            sChallengeModes->hardcoreXpBonus         = sConfigMgr->GetOption<float>("Hardcore.XPMultiplier", 1.0f);
-            sChallengeModes->semiHardcoreXpBonus     = sConfigMgr->GetOption<float>("SemiHardcore.XPMultiplier", 1.0f);
-            sChallengeModes->selfCraftedXpBonus      = sConfigMgr->GetOption<float>("SelfCrafted.XPMultiplier", 1.0f);
-            sChallengeModes->itemQualityLevelXpBonus = sConfigMgr->GetOption<float>("ItemQualityLevel.XPMultiplier", 1.0f);
-            sChallengeModes->questXpOnlyXpBonus      = sConfigMgr->GetOption<float>("QuestXpOnly.XPMultiplier", 1.0f);
+            // Interactions without another player have nobody to share the challenge with
+            if (interaction == CHALLENGE_INTERACTION_MAX || !ChallengeInteractionDescriptors[interaction].targetRestricted)
+            {
+                LOG_ERROR("mod-challenge-modes", "{}: unknown interaction '{}', expected trade, mail or group.", confName, token);
+                continue;
+            }
+            config.sameChallengeInteractions |= 1 << interaction;
         }
     }
 };
 
-class ChallengeMode : public PlayerScript
+// Registered before the challenge scripts so it sees every hook with its original arguments
+class ChallengeTraceScripts : public PlayerScript
 {
 public:
-    explicit ChallengeMode(const char *scriptName,
-                           ChallengeModeSettings settingName)
-            : PlayerScript(scriptName), settingName(settingName)
-    { }
+    ChallengeTraceScripts() : PlayerScript("ChallengeTraceScripts") { }
 
-    static bool mapContainsKey(const std::unordered_map<uint8, uint32>* mapToCheck, uint8 key)
+    void OnGiveXP(Player* /*player*/, uint32& amount, Unit* /*victim*/) override
     {
-        return (mapToCheck->find(key) != mapToCheck->end());
+        if (sChallengeModesTrace->traceEnabled)
+        {
+            sChallengeModesTrace->BeginXp(amount);
+        }
     }
 
-    void OnGiveXP(Player* player, uint32& amount, Unit* /*victim*/) override
+    bool CanEquipItem(Player* player, uint8 /*slot*/, uint16& /*dest*/, Item* pItem, bool /*swap*/, bool /*not_loading*/) override
     {
-        sChallengeModes->TryMarkDirty(player);
-        if (!sChallengeModes->challengeEnabledForPlayer(settingName, player))
+        if (sChallengeModesTrace->traceEnabled)
         {
-            return;
+            sChallengeModesTrace->RecordEquip(player, pItem);
         }
-        amount *= sChallengeModes->getXpBonusForChallenge(settingName);
+        return true;
     }
 
-    void OnLevelChanged(Player* player, uint8 /*oldlevel*/) override
+    bool CanUseItem(Player* player, ItemTemplate const* proto, InventoryResult& /*result*/) override
+    {
+        if (sChallengeModesTrace->traceEnabled)
+        {
+            sChallengeModesTrace->RecordUse(player, proto);
+        }
+        return true;
+    }
+
+    void OnLearnSpell(Player* player, uint32 spellID) override
+    {
+        if (sChallengeModesTrace->traceEnabled)
+        {
+            sChallengeModesTrace->RecordSpell(player, spellID);
+        }
+    }
+};
+
+// Applies the XP adjustments of all challenges with one challenge mask lookup, where every challenge script used
+// to look up the mask on its own
+class ChallengeXpScripts : public PlayerScript
+{
+public:
+    ChallengeXpScripts() : PlayerScript("ChallengeXpScripts") { }
+
+    void OnGiveXP(Player* player, uint32& amount, Unit* victim) override
+    {
+        sChallengeModes->AdjustXp(player, amount, victim != nullptr);
+    }
+};
+
+class ChallengeMode : public PlayerScript
+{
+public:
+    explicit ChallengeMode(const char *scriptName,
+                           ChallengeModeSettings settingName)
+            : PlayerScript(scriptName), settingName(settingName)
+    { }
+
+    void OnLevelChanged(Player* player, uint8 oldlevel) override
     {
         if (!sChallengeModes->challengeEnabledForPlayer(settingName, player))
         {
             return;
         }
-        const std::unordered_map<uint8, uint32> *titleRewardMap = sChallengeModes->getTitleMapForChallenge(settingName);
-        const std::unordered_map<uint8, uint32> *talentRewardMap = sChallengeModes->getTalentMapForChallenge(settingName);
-        const std::unordered_map<uint8, uint32> *itemRewardMap = sChallengeModes->getItemMapForChallenge(settingName);
+        // The level start time is moved forward by ChallengeMiscPlayerScripts, which runs after the challenge scripts
+        if (ChallengeModePlayerData const* data = ChallengeModes::GetPlayerData(player))
+        {
+            sChallengeModesTelemetry->RecordLevelUp(settingName, oldlevel, player->GetTotalPlayedTime() - data->levelStartTime);
+        }
+        const ChallengeTitleRewardMap *titleRewardMap = sChallengeModes->getTitleMapForChallenge(settingName);
+        const ChallengeRewardMap *talentRewardMap = sChallengeModes->getTalentMapForChallenge(settingName);
+        const ChallengeRewardMap *itemRewardMap = sChallengeModes->getItemMapForChallenge(settingName);
         uint8 level = player->GetLevel();
 
         // Disable modes at 80
         if (level == 80)
         {
-            player->UpdatePlayerSetting("mod-challenge-modes", settingName, 0);
+            sChallengeModes->SetChallengeSetting(player, settingName, false);
+            sChallengeModes->NotifyEvent(CHALLENGE_EVENT_GRADUATED, player, ChallengeMask(settingName));
         }
 
-        if (mapContainsKey(titleRewardMap, level))
+        // Rewards are validated when the config is loaded, so the entries here are always valid.
+        auto titleItr = titleRewardMap->find(level);
+        if (titleItr != titleRewardMap->end())
         {
-            CharTitlesEntry const* titleInfo = sCharTitlesStore.LookupEntry(titleRewardMap->at(level));
-            if (!titleInfo)
-            {
-                LOG_ERROR("mod-challenge-modes", "Invalid title ID {}!", titleRewardMap->at(level));
-                return;
-            }
-            ChatHandler handler(player->GetSession());
-            std::string tNameLink = handler.GetNameLink(player);
-            std::string titleNameStr = Acore::StringFormat(player->getGender() == GENDER_MALE ? titleInfo->nameMale[handler.GetSessionDbcLocale()] : titleInfo->nameFemale[handler.GetSessionDbcLocale()], player->GetName());
-            player->SetTitle(titleInfo);
+            player->SetTitle(titleItr->second);
         }
-        if (mapContainsKey(talentRewardMap, level))
+        auto talentItr = talentRewardMap->find(level);
+        if (talentItr != talentRewardMap->end())
         {
-            player->RewardExtraBonusTalentPoints(talentRewardMap->at(level));
+            player->RewardExtraBonusTalentPoints(talentItr->second);
         }
-        if (mapContainsKey(itemRewardMap, level))
+        auto itemItr = itemRewardMap->find(level);
+        if (itemItr != itemRewardMap->end())
         {
-            // Mail item to player
-            uint32 itemEntry = itemRewardMap->at(level);
-            player->SendItemRetrievalMail({ { itemEntry, 1 } });
+            sChallengeModes->SendRewardItem(player, itemItr->second);
         }
     }
 
-    PlayerSettingMap* GetPlayerSettingsFromDB(ObjectGuid guid)
+private:
+    ChallengeModeSettings settingName;
+};
+
+class ChallengeServerScripts : public ServerScript
+{
+public:
+    ChallengeServerScripts() : ServerScript("ChallengeServerScripts") { }
+
+    bool CanPacketReceive(WorldSession* session, WorldPacket& packet) override
     {
-        PlayerSettingMap* settingMap = new PlayerSettingMap();
+        // Start loading the module state as soon as a character is selected, so it is in memory by OnLogin.
+        // The packet runs before the core's own checks, so they are repeated here: the GUID is sent by the client
+        // and the packet can be repeated.
+        if (packet.GetOpcode() != CMSG_PLAYER_LOGIN || !sChallengeModes->enabled() || packet.size() < sizeof(uint64) ||
+            session->GetPlayer() || session->PlayerLoading())
+        {
+            return true;
+        }
 
-        auto result = CharacterDatabase.Query("SELECT source, data FROM character_settings WHERE guid = {}", guid.GetRawValue());
+        ObjectGuid guid(packet.read<uint64>(0));
+        if (session->IsLegitCharacterForAccount(guid))
+        {
+            sChallengeModes->PrefetchPlayerData(guid);
+        }
+        return true;
+    }
+};
 
-        if (result)
+class ChallengeMiscScripts : public MiscScript
+{
+public:
+    ChallengeMiscScripts() : MiscScript("ChallengeMiscScripts") { }
+    bool CanSendAuctionHello(WorldSession const* session, ObjectGuid /*guid*/, Creature* /*creature*/) override
+    {
+        if (!session->GetPlayer())
         {
-            do
-            {
-                Field* fields = result->Fetch();
+            return true;
+        }
+
+        auto player = session->GetPlayer();
 
-                std::string source = fields[0].Get<std::string>();
-                std::string data = fields[1].Get<std::string>();
+        sChallengeModes->TryMarkDirty(player);
 
-                std::vector<std::string_view> tokens = Acore::Tokenize(data, ' ', false);
+        return !sChallengeModes->IsInteractionRestricted(CHALLENGE_INTERACTION_AUCTION_HOUSE) || sChallengeModes->CanInteract(player, 0, CHALLENGE_INTERACTION_AUCTION_HOUSE);
+    }
+};
 
-                PlayerSettingVector setting;
-                setting.resize(tokens.size());
+class ChallengeMiscPlayerScripts : public PlayerScript
+{
+public:
+    ChallengeMiscPlayerScripts() : PlayerScript("ChallengeMiscPlayerScripts") { }
 
-                uint32 count = 0;
+    void OnLogin(Player* player) override
+    {
+        if (!player || !sChallengeModes->enabled())
+        {
+            return;
+        }
 
-                for (auto token : tokens)
-                {
-                    if (token.empty())
-                    {
-                        continue;
-                    }
+        sChallengeModes->HydratePlayerData(player);
 
-                    PlayerSetting set;
-                    set.value = Acore::StringTo<uint32>(token).value();
-                    setting[count] = set;
-                    ++count;
-                }
+        // Revived by a game master while offline, before the check below flags the ghost as fallen again
+        if (player->GetPlayerSetting("mod-challenge-modes", PLAYER_SETTING_REVIVE).value == 1)
+        {
+            sChallengeModes->SetPlayerSetting(player, PLAYER_SETTING_REVIVE, 0);
+            sChallengeModes->RevivePlayer(player);
+        }
 
-                (*settingMap)[source] = setting;
+        // Characters that died before the fallen flag existed are flagged on their next login.
+        if (player->isDead() && sChallengeModes->TryMarkFallen(player))
+        {
+            sChallengeModes->QueueFallen(player);
+        }
 
-            } while (result->NextRow());
+        uint32 activeMask = sChallengeModes->GetActiveChallengeMask(player);
+        if (!activeMask)
+        {
+            return;
+        }
+
+        std::stringstream ss;
+        ss << "Challenge Modes Enabled: ";
+        for (uint8 i = 0; i < SETTING_MODE_MAX; ++i)
+        {
+            if (activeMask & ChallengeMask(ChallengeModeSettings(i)))
+            {
+                ss << sChallengeModes->GetChallengeNameFromEnum(i);
+                ss << ", ";
+            }
         }
 
-        return settingMap;
+        ChatHandler(player->GetSession()).SendSysMessage(ss.str());
     }
 
-    bool HasPlayerSetting(PlayerSettingMap* m_charSettingsMap, std::string source, uint8 index)
+    void OnLogout(Player* player) override
     {
-        auto itr = m_charSettingsMap->find(source);
-
-        if (itr == m_charSettingsMap->end())
+        // Only characters that logged in while the module was enabled have state to save or an entry to remove
+        if (!ChallengeModes::GetPlayerData(player))
         {
-            return false;
+            return;
         }
+        sChallengeModes->SaveItemProvenance(player);
+        sChallengeModesRegistry->Remove(player->GetGUID());
+    }
+
+    void OnSave(Player* player) override
+    {
+        sChallengeModes->SaveItemProvenance(player);
+    }
 
-        PlayerSettingVector settingVector = itr->second;
-        if (settingVector.size() < (uint8)(index + 1))
+    void OnLevelChanged(Player* player, uint8 /*oldlevel*/) override
+    {
+        if (ChallengeModePlayerData* data = ChallengeModes::GetPlayerData(player))
         {
-            return false;
+            sChallengeModesRegistry->UpdateLevel(player);
+            data->levelStartTime = player->GetTotalPlayedTime();
         }
+    }
 
-        return settingVector.at(index).value == 1;
+    void OnDelete(ObjectGuid guid, uint32 /*accountId*/) override
+    {
+        CharacterDatabase.Execute("DELETE FROM character_challenge_modes WHERE guid = {}", guid.GetCounter());
+        CharacterDatabase.Execute("DELETE FROM character_challenge_item_provenance WHERE owner_guid = {}", guid.GetCounter());
     }
 
-    bool CanSendMail(Player* player, ObjectGuid receiverGUID, ObjectGuid /*mailbox*/, std::string& /*subject*/, std::string& /*body*/, uint32 /*money*/, uint32 /*COD*/, Item* /*item*/) override
+    void OnPlayerJustDied(Player* player) override
     {
-        if (!sChallengeModes->enabled())
+        uint32 enforcedMask = sChallengeModes->GetEnforcedChallengeMask(player);
+        if (!enforcedMask)
         {
-            return true;
+            return;
         }
 
-        auto targetPlayer = ObjectAccessor::FindPlayer(receiverGUID);
+        sChallengeModes->NotifyEvent(CHALLENGE_EVENT_DEATH, player, enforcedMask);
 
-        // Load offline player settings.
-        PlayerSettingMap* playerSettings = nullptr;
-        if (!targetPlayer)
+        if (sChallengeModes->TryMarkFallen(player))
         {
-            playerSettings = GetPlayerSettingsFromDB(receiverGUID);
+            sChallengeModes->QueueFallen(player);
         }
+    }
 
-        if (sChallengeModes->challengeEnabled(SETTING_HARDCORE))
+    void OnPlayerResurrect(Player* player, float /*restore_percent*/, bool /*applySickness*/) override
+    {
+        if (!sChallengeModes->enabled() || !sChallengeModes->isFallen(player))
         {
-            if ((targetPlayer && targetPlayer->GetPlayerSetting("mod-challenge-modes", SETTING_HARDCORE).value == 1) ||
-                (playerSettings && HasPlayerSetting(playerSettings, "mod-challenge-modes", SETTING_HARDCORE)) /* Fallback to DB */)
-            {
-                ChatHandler(player->GetSession()).SendSysMessage("You can't send mail to hardcore players.");
-                return false;
-            }
+            return;
         }
+        // A better implementation is to not allow the resurrect but this will need a new hook added first
+        player->KillPlayer();
+    }
 
-        if (sChallengeModes->challengeEnabled(SETTING_SELF_CRAFTED))
+    void OnGiveXP(Player* player, uint32& amount, Unit* victim) override
+    {
+        sChallengeModes->TryMarkDirty(player);
+        if (sChallengeModesTrace->traceEnabled)
         {
-            if ((targetPlayer && targetPlayer->GetPlayerSetting("mod-challenge-modes", SETTING_SELF_CRAFTED).value == 1) ||
-                (playerSettings && HasPlayerSetting(playerSettings, "mod-challenge-modes", SETTING_SELF_CRAFTED)) /* Fallback to DB */)
-            {
-                ChatHandler(player->GetSession()).SendSysMessage("You can't send mail to self-crafted players.");
-                return false;
-            }
+            sChallengeModesTrace->RecordXp(player, amount, victim != nullptr);
         }
+    }
+    void OnMoneyChanged(Player* player, int32& /*amount*/) override { sChallengeModes->TryMarkDirty(player); }
 
-        return true;
+    // OnStoreNewItem runs inside StoreNewItem, the hooks below run after it and refine the source of the item
+    void OnStoreNewItem(Player* player, Item* item, uint32 /*count*/) override
+    {
+        sChallengeModes->TryMarkDirty(player);
+        sChallengeModes->RecordItemSource(player, item, ITEM_SOURCE_OTHER);
     }
 
-private:
-    ChallengeModeSettings settingName;
-};
+    void OnLootItem(Player* player, Item* item, uint32 /*count*/, ObjectGuid /*lootguid*/) override
+    {
+        sChallengeModes->TryMarkDirty(player);
+        sChallengeModes->RecordItemSource(player, item, ITEM_SOURCE_LOOTED);
+    }
 
-class ChallengeMiscScripts : public MiscScript
-{
-public:
-    ChallengeMiscScripts() : MiscScript("ChallengeMiscScripts") { }
-    bool CanSendAuctionHello(WorldSession const* session, ObjectGuid /*guid*/, Creature* /*creature*/) override
+    void OnCreateItem(Player* player, Item* item, uint32 /*count*/) override
     {
-        if (!session->GetPlayer())
-        {
-            return true;
-        }
+        sChallengeModes->TryMarkDirty(player);
+        sChallengeModes->RecordItemSource(player, item, ITEM_SOURCE_CRAFTED);
+    }
 
-        auto player = session->GetPlayer();
+    void OnQuestRewardItem(Player* player, Item* item, uint32 /*count*/) override
+    {
+        sChallengeModes->TryMarkDirty(player);
+        sChallengeModes->RecordItemSource(player, item, ITEM_SOURCE_QUEST);
+    }
 
+    void OnGroupRollRewardItem(Player* player, Item* item, uint32 /*count*/, RollVote /*voteType*/, Roll* /*roll*/) override
+    {
         sChallengeModes->TryMarkDirty(player);
+        sChallengeModes->RecordItemSource(player, item, ITEM_SOURCE_LOOTED);
+    }
 
-        auto isHardcore = player->GetPlayerSetting("mod-challenge-modes", SETTING_HARDCORE).value == 1;
-        auto isSelfCrafted = player->GetPlayerSetting("mod-challenge-modes", SETTING_SELF_CRAFTED).value == 1;
+    void OnAfterStoreOrEquipNewItem(Player* player, uint32 /*vendorslot*/, Item* item, uint8 /*count*/, uint8 /*bag*/, uint8 /*slot*/, ItemTemplate const* /*pProto*/, Creature* /*pVendor*/, VendorItem const* /*crItem*/, bool /*bStore*/) override
+    {
+        sChallengeModes->TryMarkDirty(player);
+        sChallengeModes->RecordItemSource(player, item, ITEM_SOURCE_VENDOR);
+    }
 
-        if (isHardcore)
+    // A completed trade moves the items out of the inventory while both sides have accepted, so the item is only
+    // recorded for the receiver once the trade goes through. Traded items keep their GUID and are not stored with
+    // StoreNewItem, so this is also where receiving an item makes a fresh character dirty.
+    void OnAfterMoveItemFromInventory(Player* player, Item* item, uint8 /*bag*/, uint8 /*slot*/, bool /*update*/) override
+    {
+        TradeData* trade = player->GetTradeData();
+        Player* trader = player->GetTrader();
+        if (!trade || !trade->IsAccepted() || !trader || !trader->GetTradeData() || !trader->GetTradeData()->IsAccepted())
         {
-            ChatHandler(player->GetSession()).SendSysMessage("You cannot use the auction house in hardcore mode.");
-            return false;
+            return;
         }
+        sChallengeModes->TryMarkDirty(trader);
+        sChallengeModes->RecordItemSource(trader, item, ITEM_SOURCE_TRADED);
+    }
 
-        if (isSelfCrafted)
+    // Interaction hooks, resolved with the policy table built at config load
+    bool CanInitTrade(Player* player, Player* target) override
+    {
+        if (sChallengeModes->IsInteractionRestricted(CHALLENGE_INTERACTION_TRADE) &&
+            !sChallengeModes->CanInteract(player, sChallengeModes->GetRestrictedChallengeMask(target), CHALLENGE_INTERACTION_TRADE))
         {
-            ChatHandler(player->GetSession()).SendSysMessage("You cannot use the auction house in self-crafted mode.");
             return false;
         }
-
+        sChallengeModes->TryMarkDirty(player);
+        sChallengeModes->TryMarkDirty(target);
         return true;
     }
-};
-
-class ChallengeMiscPlayerScripts : public PlayerScript
-{
-public:
-    ChallengeMiscPlayerScripts() : PlayerScript("ChallengeMiscPlayerScripts") { }
 
-    void OnLogin(Player* player) override
+    bool CanSendMail(Player* player, ObjectGuid receiverGUID, ObjectGuid /*mailbox*/, std::string& /*subject*/, std::string& /*body*/, uint32 /*money*/, uint32 /*COD*/, Item* /*item*/) override
     {
-        if (!player)
+        // Skips the offline lookup below when no challenge restricts mail
+        if (!sChallengeModes->IsInteractionRestricted(CHALLENGE_INTERACTION_MAIL))
         {
-            return;
+            return true;
         }
+        return sChallengeModes->CanInteract(player, sChallengeModes->GetRestrictedChallengeMask(receiverGUID), CHALLENGE_INTERACTION_MAIL);
+    }
 
-        std::stringstream ss;
-        ss << "Challenge Modes Enabled: ";
-
-        uint8 enabledCount = 0;
-        for (uint8 i = 0; i < SETTING_MODE_MAX; ++i)
+    bool CanGroupInvite(Player* player, std::string& membername) override
+    {
+        if (!sChallengeModes->IsInteractionRestricted(CHALLENGE_INTERACTION_GROUP))
         {
-            auto setting = player->GetPlayerSetting("mod-challenge-modes", i);
-            if (setting.value == 1)
-            {
-                ss << sChallengeModes->GetChallengeNameFromEnum(i);
-                ss << ", ";
-                enabledCount++;
-            }
+            return true;
         }
+        Player* target = ObjectAccessor::FindPlayerByName(membername, false);
+        return sChallengeModes->CanInteract(player, target ? sChallengeModes->GetRestrictedChallengeMask(target) : 0, CHALLENGE_INTERACTION_GROUP);
+    }
 
-        if (enabledCount == 0)
+    bool CanGroupAccept(Player* player, Group* group) override
+    {
+        if (!sChallengeModes->IsInteractionRestricted(CHALLENGE_INTERACTION_GROUP))
         {
-            return;
+            return true;
         }
-
-        ChatHandler(player->GetSession()).SendSysMessage(ss.str());
+        Player* leader = ObjectAccessor::FindConnectedPlayer(group->GetLeaderGUID());
+        return sChallengeModes->CanInteract(player, leader ? sChallengeModes->GetRestrictedChallengeMask(leader) : 0, CHALLENGE_INTERACTION_GROUP);
     }
-
-    void OnLootItem(Player* player, Item* /*item*/, uint32 /*count*/, ObjectGuid /*lootguid*/) override { sChallengeModes->TryMarkDirty(player); }
-    void OnStoreNewItem(Player* player, Item* /*item*/, uint32 /*count*/) override { sChallengeModes->TryMarkDirty(player); }
-    void OnCreateItem(Player* player, Item* /*item*/, uint32 /*count*/) override { sChallengeModes->TryMarkDirty(player); }
-    void OnQuestRewardItem(Player* player, Item* /*item*/, uint32 /*count*/) override { sChallengeModes->TryMarkDirty(player); }
-    void OnGroupRollRewardItem(Player* player, Item* /*item*/, uint32 /*count*/, RollVote /*voteType*/, Roll* /*roll*/) override { sChallengeModes->TryMarkDirty(player); }
-    void OnMoneyChanged(Player* player, int32& /*amount*/) override { sChallengeModes->TryMarkDirty(player); }
-    void OnAfterStoreOrEquipNewItem(Player* player, uint32 /*vendorslot*/, Item* /*item*/, uint8 /*count*/, uint8 /*bag*/, uint8 /*slot*/, ItemTemplate const* /*pProto*/, Creature* /*pVendor*/, VendorItem const* /*crItem*/, bool /*bStore*/) override { sChallengeModes->TryMarkDirty(player); }
-    bool CanInitTrade(Player* player, Player* target) override { sChallengeModes->TryMarkDirty(player); sChallengeModes->TryMarkDirty(target); return true; }
 };
 
 class ChallengeGuildScripts : public GuildScript
@@ -508,25 +1729,11 @@ public:
 
         sChallengeModes->TryMarkDirty(player);
 
-        auto isHardcore = player->GetPlayerSetting("mod-challenge-modes", SETTING_HARDCORE).value == 1;
-        auto isSelfCrafted = player->GetPlayerSetting("mod-challenge-modes", SETTING_SELF_CRAFTED).value == 1;
-
-        if (isHardcore)
-        {
-            ChatHandler(player->GetSession()).SendSysMessage("You cannot use the guild bank in hardcore mode.");
-            return false;
-        }
-
-        if (isSelfCrafted)
-        {
-            ChatHandler(player->GetSession()).SendSysMessage("You cannot use the guild bank in self-crafted mode.");
-            return false;
-        }
-
-        return true;
+        return !sChallengeModes->IsInteractionRestricted(CHALLENGE_INTERACTION_GUILD_BANK) || sChallengeModes->CanInteract(player, 0, CHALLENGE_INTERACTION_GUILD_BANK);
     }
 };
 
+#if CHALLENGE_MODES_WITH_HARDCORE
 class ChallengeMode_Hardcore : public ChallengeMode
 {
 public:
@@ -534,7 +1741,7 @@ public:
 
     void OnPlayerResurrect(Player* player, float /*restore_percent*/, bool /*applySickness*/) override
     {
-        if (!sChallengeModes->challengeEnabledForPlayer(SETTING_HARDCORE, player))
+        if (!sChallengeModes->challengeEnabledForPlayer(SETTING_HARDCORE, player) || sChallengeModes->IsReviving(player))
         {
             return;
         }
@@ -542,36 +1749,14 @@ public:
         player->KillPlayer();
     }
 
-    void OnGiveXP(Player* player, uint32& amount, Unit* victim) override
-    {
-        ChallengeMode::OnGiveXP(player, amount, victim);
-    }
-
     void OnLevelChanged(Player* player, uint8 oldlevel) override
     {
         ChallengeMode::OnLevelChanged(player, oldlevel);
     }
-
-    bool CanInitTrade(Player* player, Player* target) override
-    {
-        if (sChallengeModes->challengeEnabledForPlayer(SETTING_HARDCORE, player))
-        {
-            ChatHandler(player->GetSession()).SendSysMessage("You cannot trade with other players while in hardcore mode.");
-
-            return false;
-        }
-
-        if (sChallengeModes->challengeEnabledForPlayer(SETTING_HARDCORE, target))
-        {
-            ChatHandler(player->GetSession()).SendSysMessage("You cannot trade with players in hardcore mode.");
-
-            return false;
-        }
-
-        return true;
-    }
 };
+#endif
 
+#if CHALLENGE_MODES_WITH_SEMI_HARDCORE
 class ChallengeMode_SemiHardcore : public ChallengeMode
 {
 public:
@@ -597,73 +1782,74 @@ public:
         player->SetMoney(0);
     }
 
-    void OnGiveXP(Player* player, uint32& amount, Unit* victim) override
-    {
-        ChallengeMode::OnGiveXP(player, amount, victim);
-    }
-
     void OnLevelChanged(Player* player, uint8 oldlevel) override
     {
         ChallengeMode::OnLevelChanged(player, oldlevel);
     }
 };
+#endif
 
+#if CHALLENGE_MODES_WITH_SELF_CRAFTED
 class ChallengeMode_SelfCrafted : public ChallengeMode
 {
 public:
     ChallengeMode_SelfCrafted() : ChallengeMode("ChallengeMode_SelfCrafted", SETTING_SELF_CRAFTED) {}
 
-    bool CanEquipItem(Player* player, uint8 /*slot*/, uint16& /*dest*/, Item* pItem, bool /*swap*/, bool /*not_loading*/) override
+    bool CanEquipItem(Player* player, uint8 /*slot*/, uint16& /*dest*/, Item* pItem, bool /*swap*/, bool not_loading) override
     {
-        if (!sChallengeModes->challengeEnabledForPlayer(SETTING_SELF_CRAFTED, player))
+        // The provenance is not loaded yet, the compliance audit unequips the items that break the rule afterwards
+        if (!not_loading)
         {
             return true;
         }
 
-        // Allow fishing poles to be equipped since you cannot craft them.
-        if (pItem->GetTemplate()->Class == ITEM_CLASS_WEAPON &&
-            pItem->GetTemplate()->SubClass == ITEM_SUBCLASS_WEAPON_FISHING_POLE)
+        if (!sChallengeModes->challengeRestrictsPlayer(SETTING_SELF_CRAFTED, player))
         {
+            // Unsigned items are only known to be crafted from the provenance, which is not recorded for characters
+            // without a provenance rule. They are left out rather than counted as rejections.
+            if (sChallengeModesShadow->IsShadowed(SETTING_SELF_CRAFTED) && (pItem->GetTemplate()->HasSignature() || ChallengeModes::HasItemProvenance(player, pItem)))
+            {
+                sChallengeModesShadow->Evaluate(SETTING_SELF_CRAFTED, SHADOW_HOOK_EQUIP_ITEM, player, [&] { return !ChallengeModes::IsSelfCraftedItem(player, pItem); });
+            }
             return true;
         }
 
-        if (!pItem->GetTemplate()->HasSignature())
-        {
-            return false;
-        }
-        return pItem->GetGuidValue(ITEM_FIELD_CREATOR) == player->GetGUID();
-    }
-
-    void OnGiveXP(Player* player, uint32& amount, Unit* victim) override
-    {
-        ChallengeMode::OnGiveXP(player, amount, victim);
+        return ChallengeModes::IsSelfCraftedItem(player, pItem);
     }
 
     void OnLevelChanged(Player* player, uint8 oldlevel) override
     {
         ChallengeMode::OnLevelChanged(player, oldlevel);
     }
+};
+#endif
 
-    bool CanInitTrade(Player* player, Player* target) override
+#if CHALLENGE_MODES_WITH_SELF_FOUND
+class ChallengeMode_SelfFound : public ChallengeMode
+{
+public:
+    ChallengeMode_SelfFound() : ChallengeMode("ChallengeMode_SelfFound", SETTING_SELF_FOUND) {}
+
+    bool CanEquipItem(Player* player, uint8 /*slot*/, uint16& /*dest*/, Item* pItem, bool /*swap*/, bool not_loading) override
     {
-        if (sChallengeModes->challengeEnabledForPlayer(SETTING_SELF_CRAFTED, player))
+        // No shadow evaluation, the provenance is only recorded for characters with a provenance rule. While the
+        // character loads the provenance is not known yet, the compliance audit checks the items afterwards.
+        if (!not_loading || !sChallengeModes->challengeRestrictsPlayer(SETTING_SELF_FOUND, player))
         {
-            ChatHandler(player->GetSession()).SendSysMessage("You cannot trade with other players while in self-crafted mode.");
-
-            return false;
+            return true;
         }
 
-        if (sChallengeModes->challengeEnabledForPlayer(SETTING_SELF_CRAFTED, target))
-        {
-            ChatHandler(player->GetSession()).SendSysMessage("You cannot trade with players in self-crafted mode.");
-
-            return false;
-        }
+        return ChallengeModes::IsSelfFoundItem(player, pItem);
+    }
 
-        return true;
+    void OnLevelChanged(Player* player, uint8 oldlevel) override
+    {
+        ChallengeMode::OnLevelChanged(player, oldlevel);
     }
 };
+#endif
 
+#if CHALLENGE_MODES_WITH_ITEM_QUALITY_LEVEL
 class ChallengeMode_ItemQualityLevel : public ChallengeMode
 {
 public:
@@ -671,16 +1857,15 @@ public:
 
     bool CanEquipItem(Player* player, uint8 /*slot*/, uint16& /*dest*/, Item* pItem, bool /*swap*/, bool /*not_loading*/) override
     {
-        if (!sChallengeModes->challengeEnabledForPlayer(SETTING_ITEM_QUALITY_LEVEL, player))
+        if (!sChallengeModes->challengeRestrictsPlayer(SETTING_ITEM_QUALITY_LEVEL, player))
         {
+            if (sChallengeModesShadow->IsShadowed(SETTING_ITEM_QUALITY_LEVEL))
+            {
+                sChallengeModesShadow->Evaluate(SETTING_ITEM_QUALITY_LEVEL, SHADOW_HOOK_EQUIP_ITEM, player, [&] { return !ChallengeModes::IsLowQualityItem(pItem->GetTemplate()); });
+            }
             return true;
         }
-        return pItem->GetTemplate()->Quality <= ITEM_QUALITY_NORMAL;
-    }
-
-    void OnGiveXP(Player* player, uint32& amount, Unit* victim) override
-    {
-        ChallengeMode::OnGiveXP(player, amount, victim);
+        return ChallengeModes::IsLowQualityItem(pItem->GetTemplate());
     }
 
     void OnLevelChanged(Player* player, uint8 oldlevel) override
@@ -688,66 +1873,48 @@ public:
         ChallengeMode::OnLevelChanged(player, oldlevel);
     }
 };
+#endif
 
+#if CHALLENGE_MODES_WITH_SLOW_XP_GAIN
 class ChallengeMode_SlowXpGain : public ChallengeMode
 {
 public:
     ChallengeMode_SlowXpGain() : ChallengeMode("ChallengeMode_SlowXpGain", SETTING_SLOW_XP_GAIN) {}
 
-    void OnGiveXP(Player* player, uint32& amount, Unit* victim) override
-    {
-        ChallengeMode::OnGiveXP(player, amount, victim);
-    }
-
     void OnLevelChanged(Player* player, uint8 oldlevel) override
     {
         ChallengeMode::OnLevelChanged(player, oldlevel);
     }
 };
+#endif
 
+#if CHALLENGE_MODES_WITH_VERY_SLOW_XP_GAIN
 class ChallengeMode_VerySlowXpGain : public ChallengeMode
 {
 public:
     ChallengeMode_VerySlowXpGain() : ChallengeMode("ChallengeMode_VerySlowXpGain", SETTING_VERY_SLOW_XP_GAIN) {}
 
-    void OnGiveXP(Player* player, uint32& amount, Unit* victim) override
-    {
-        ChallengeMode::OnGiveXP(player, amount, victim);
-    }
-
     void OnLevelChanged(Player* player, uint8 oldlevel) override
     {
         ChallengeMode::OnLevelChanged(player, oldlevel);
     }
 };
+#endif
 
+#if CHALLENGE_MODES_WITH_QUEST_XP_ONLY
 class ChallengeMode_QuestXpOnly : public ChallengeMode
 {
 public:
     ChallengeMode_QuestXpOnly() : ChallengeMode("ChallengeMode_QuestXpOnly", SETTING_QUEST_XP_ONLY) {}
 
-    void OnGiveXP(Player* player, uint32& amount, Unit* victim) override
-    {
-        if (!sChallengeModes->challengeEnabledForPlayer(SETTING_QUEST_XP_ONLY, player))
-        {
-            return;
-        }
-        if (victim)
-        {
-            amount = 0;
-        }
-        else
-        {
-            ChallengeMode::OnGiveXP(player, amount, victim);
-        }
-    }
-
     void OnLevelChanged(Player* player, uint8 oldlevel) override
     {
         ChallengeMode::OnLevelChanged(player, oldlevel);
     }
 };
+#endif
 
+#if CHALLENGE_MODES_WITH_IRON_MAN
 class ChallengeMode_IronMan : public ChallengeMode
 {
 public:
@@ -755,7 +1922,7 @@ public:
 
     void OnPlayerResurrect(Player* player, float /*restore_percent*/, bool /*applySickness*/) override
     {
-        if (!sChallengeModes->challengeEnabledForPlayer(SETTING_IRON_MAN, player))
+        if (!sChallengeModes->challengeEnabledForPlayer(SETTING_IRON_MAN, player) || sChallengeModes->IsReviving(player))
         {
             return;
         }
@@ -763,14 +1930,9 @@ public:
         player->KillPlayer();
     }
 
-    void OnGiveXP(Player* player, uint32& amount, Unit* victim) override
-    {
-        ChallengeMode::OnGiveXP(player, amount, victim);
-    }
-
     void OnLevelChanged(Player* player, uint8 oldlevel) override
     {
-        if (!sChallengeModes->challengeEnabledForPlayer(SETTING_IRON_MAN, player))
+        if (!sChallengeModes->challengeRestrictsPlayer(SETTING_IRON_MAN, player))
         {
             return;
         }
@@ -780,7 +1942,7 @@ public:
 
     void OnTalentsReset(Player* player, bool /*noCost*/) override
     {
-        if (!sChallengeModes->challengeEnabledForPlayer(SETTING_IRON_MAN, player))
+        if (!sChallengeModes->challengeRestrictsPlayer(SETTING_IRON_MAN, player))
         {
             return;
         }
@@ -789,52 +1951,38 @@ public:
 
     bool CanEquipItem(Player* player, uint8 /*slot*/, uint16& /*dest*/, Item* pItem, bool /*swap*/, bool /*not_loading*/) override
     {
-        if (!sChallengeModes->challengeEnabledForPlayer(SETTING_IRON_MAN, player))
+        if (!sChallengeModes->challengeRestrictsPlayer(SETTING_IRON_MAN, player))
         {
+            if (sChallengeModesShadow->IsShadowed(SETTING_IRON_MAN))
+            {
+                sChallengeModesShadow->Evaluate(SETTING_IRON_MAN, SHADOW_HOOK_EQUIP_ITEM, player, [&] { return !ChallengeModes::IsLowQualityItem(pItem->GetTemplate()); });
+            }
             return true;
         }
-        return pItem->GetTemplate()->Quality <= ITEM_QUALITY_NORMAL;
+        return ChallengeModes::IsLowQualityItem(pItem->GetTemplate());
     }
 
-    bool CanApplyEnchantment(Player* player, Item* /*item*/, EnchantmentSlot /*slot*/, bool /*apply*/, bool /*apply_dur*/, bool /*ignore_condition*/) override
+    bool CanApplyEnchantment(Player* player, Item* item, EnchantmentSlot slot, bool apply, bool /*apply_dur*/, bool /*ignore_condition*/) override
     {
-        if (!sChallengeModes->challengeEnabledForPlayer(SETTING_IRON_MAN, player))
+        if (!sChallengeModes->challengeRestrictsPlayer(SETTING_IRON_MAN, player))
         {
             return true;
         }
         // Are there any exceptions in WotLK? If so need to be added here
-        return false;
+        return sChallengeModes->CanApplyEnchantment(player, item, slot, apply);
     }
 
     void OnLearnSpell(Player* player, uint32 spellID) override
     {
-        if (!sChallengeModes->challengeEnabledForPlayer(SETTING_IRON_MAN, player))
-        {
-            return;
-        }
-        // These professions are class skills so they are always acceptable
-        switch (spellID)
-        {
-            case RUNEFORGING:
-            case POISONS:
-            case BEAST_TRAINING:
-                return;
-            default:
-                break;
-        }
-        // Do not allow learning any trade skills
-        SpellInfo const* spellInfo = sSpellMgr->GetSpellInfo(spellID);
-        if (!spellInfo)
-            return;
-        bool shouldForget = false;
-        for (uint8 i = 0; i < 3; i++)
+        if (!sChallengeModes->challengeRestrictsPlayer(SETTING_IRON_MAN, player))
         {
-            if (spellInfo->Effects[i].Effect == SPELL_EFFECT_TRADE_SKILL)
+            if (sChallengeModesShadow->IsShadowed(SETTING_IRON_MAN))
             {
-                shouldForget = true;
+                sChallengeModesShadow->Evaluate(SETTING_IRON_MAN, SHADOW_HOOK_LEARN_SPELL, player, [&] { return ChallengeModes::IsForbiddenTradeSkill(spellID); });
             }
+            return;
         }
-        if (shouldForget)
+        if (ChallengeModes::IsForbiddenTradeSkill(spellID))
         {
             player->removeSpell(spellID, SPEC_MASK_ALL, false);
         }
@@ -842,65 +1990,26 @@ public:
 
     bool CanUseItem(Player* player, ItemTemplate const* proto, InventoryResult& /*result*/) override
     {
-        if (!sChallengeModes->challengeEnabledForPlayer(SETTING_IRON_MAN, player))
-        {
-            return true;
-        }
-        // Do not allow using elixir, potion, or flask
-        if (proto->Class == ITEM_CLASS_CONSUMABLE &&
-                (proto->SubClass == ITEM_SUBCLASS_POTION ||
-                proto->SubClass == ITEM_SUBCLASS_ELIXIR ||
-                proto->SubClass == ITEM_SUBCLASS_FLASK))
+        if (!sChallengeModes->challengeRestrictsPlayer(SETTING_IRON_MAN, player))
         {
-            return false;
-        }
-        // Do not allow food that gives food buffs
-        if (proto->Class == ITEM_CLASS_CONSUMABLE && proto->SubClass == ITEM_SUBCLASS_FOOD)
-        {
-            for (const auto & Spell : proto->Spells)
+            if (sChallengeModesShadow->IsShadowed(SETTING_IRON_MAN))
             {
-                SpellInfo const* spellInfo = sSpellMgr->GetSpellInfo(Spell.SpellId);
-                if (!spellInfo)
-                    continue;
-
-                for (uint8 i = 0; i < 3; i++)
-                {
-                    if (spellInfo->Effects[i].ApplyAuraName == SPELL_AURA_PERIODIC_TRIGGER_SPELL)
-                    {
-                        return false;
-                    }
-                }
+                sChallengeModesShadow->Evaluate(SETTING_IRON_MAN, SHADOW_HOOK_USE_ITEM, player, [&] { return ChallengeModes::IsForbiddenConsumable(proto); });
             }
-        }
-        return true;
-    }
-
-    bool CanGroupInvite(Player* player, std::string& /*membername*/) override
-    {
-        if (!sChallengeModes->challengeEnabledForPlayer(SETTING_IRON_MAN, player))
-        {
-            return true;
-        }
-        return false;
-    }
-
-    bool CanGroupAccept(Player* player, Group* /*group*/) override
-    {
-        if (!sChallengeModes->challengeEnabledForPlayer(SETTING_IRON_MAN, player))
-        {
             return true;
         }
-        return false;
+        return !ChallengeModes::IsForbiddenConsumable(proto);
     }
 
 };
+#endif
 
 class gobject_challenge_modes : public GameObjectScript
 {
 private:
-    static bool playerSettingEnabled(Player* player, uint8 settingIndex)
+    static bool canSelectChallenges(Player const* player)
     {
-        return player->GetPlayerSetting("mod-challenge-modes", settingIndex).value;
+        return !((player->getLevel() > 1) || (player->getClass() == CLASS_DEATH_KNIGHT && player->getLevel() > 55));
     }
 
 public:
@@ -912,7 +2021,7 @@ public:
 
         bool CanBeSeen(Player const* player) override
         {
-            if ((player->getLevel() > 1) || (player->getClass() == CLASS_DEATH_KNIGHT && player->getLevel() > 55))
+            if (!canSelectChallenges(player))
             {
                 return false;
             }
@@ -922,54 +2031,53 @@ public:
 
     bool OnGossipHello(Player* player, GameObject* go) override
     {
-        bool isDirty = playerSettingEnabled(player, SETTING_MARK_DIRTY);
-        if (isDirty)
+        if (sChallengeModes->IsDirty(player))
         {
             ChatHandler(player->GetSession()).SendSysMessage("Your character is not fresh, do not loot items or money before activiting this setting.");
             return false;
         }
 
-        if (sChallengeModes->challengeEnabled(SETTING_HARDCORE) && !playerSettingEnabled(player, SETTING_HARDCORE) && !playerSettingEnabled(player, SETTING_SEMI_HARDCORE))
-        {
-            AddGossipItemFor(player, GOSSIP_ICON_CHAT, "Enable Hardcore Mode", 0, SETTING_HARDCORE);
-        }
-        if (sChallengeModes->challengeEnabled(SETTING_SEMI_HARDCORE) && !playerSettingEnabled(player, SETTING_HARDCORE) && !playerSettingEnabled(player, SETTING_SEMI_HARDCORE))
-        {
-            AddGossipItemFor(player, GOSSIP_ICON_CHAT, "Enable Semi-Hardcore Mode", 0, SETTING_SEMI_HARDCORE);
-        }
-        if (sChallengeModes->challengeEnabled(SETTING_SELF_CRAFTED) && !playerSettingEnabled(player, SETTING_SELF_CRAFTED) && !playerSettingEnabled(player, SETTING_IRON_MAN))
-        {
-            AddGossipItemFor(player, GOSSIP_ICON_CHAT, "Enable Self-Crafted Mode", 0, SETTING_SELF_CRAFTED);
-        }
-        if (sChallengeModes->challengeEnabled(SETTING_ITEM_QUALITY_LEVEL) && !playerSettingEnabled(player, SETTING_ITEM_QUALITY_LEVEL))
+        ChallengeGossipMenu const& menu = sChallengeModes->getGossipMenu(sChallengeModes->GetActiveChallengeMask(player));
+        for (ChallengeModeSettings setting : menu.options)
         {
-            AddGossipItemFor(player, GOSSIP_ICON_CHAT, "Enable Low Quality Item Mode", 0, SETTING_ITEM_QUALITY_LEVEL);
+            AddGossipItemFor(player, GOSSIP_ICON_CHAT, ChallengeModes::descriptor(setting).gossipText, 0, setting);
         }
-        if (sChallengeModes->challengeEnabled(SETTING_SLOW_XP_GAIN) && !playerSettingEnabled(player, SETTING_SLOW_XP_GAIN) && !playerSettingEnabled(player, SETTING_VERY_SLOW_XP_GAIN))
+        SendGossipMenuFor(player, 12669, go->GetGUID());
+        return true;
+    }
+
+    bool OnGossipSelect(Player* player, GameObject* /*go*/, uint32 /*sender*/, uint32 action) override
+    {
+        CloseGossipMenuFor(player);
+
+        // The action comes from the client, so it is checked against the same rules used to build the menu.
+        if (!sChallengeModes->enabled() || !canSelectChallenges(player) || sChallengeModes->IsDirty(player) || action >= SETTING_MODE_MAX)
         {
-            AddGossipItemFor(player, GOSSIP_ICON_CHAT, "Enable Slow XP Mode", 0, SETTING_SLOW_XP_GAIN);
+            return true;
         }
-        if (sChallengeModes->challengeEnabled(SETTING_VERY_SLOW_XP_GAIN) && !playerSettingEnabled(player, SETTING_SLOW_XP_GAIN) && !playerSettingEnabled(player, SETTING_VERY_SLOW_XP_GAIN))
+
+        ChallengeGossipMenu const& menu = sChallengeModes->getGossipMenu(sChallengeModes->GetActiveChallengeMask(player));
+        if (!(menu.selectableMask & ChallengeMask(ChallengeModeSettings(action))))
         {
-            AddGossipItemFor(player, GOSSIP_ICON_CHAT, "Enable Very Slow XP Mode", 0, SETTING_VERY_SLOW_XP_GAIN);
+            ChatHandler(player->GetSession()).SendSysMessage("This challenge cannot be combined with your active challenges.");
+            return true;
         }
-        if (sChallengeModes->challengeEnabled(SETTING_QUEST_XP_ONLY) && !playerSettingEnabled(player, SETTING_QUEST_XP_ONLY))
+
+        sChallengeModes->SetChallengeSetting(player, ChallengeModeSettings(action), true);
+        if (ChallengeModes::descriptor(ChallengeModeSettings(action)).ruleFlags & CHALLENGE_PROVENANCE_RULES)
         {
-            AddGossipItemFor(player, GOSSIP_ICON_CHAT, "Enable Quest XP Only Mode", 0, SETTING_QUEST_XP_ONLY);
+            // The character is fresh, so everything it owns now is what it started with
+            sChallengeModes->RecordOwnedItems(player, ITEM_SOURCE_STARTING);
         }
-        if (sChallengeModes->challengeEnabled(SETTING_IRON_MAN) && !playerSettingEnabled(player, SETTING_IRON_MAN) && !playerSettingEnabled(player, SETTING_SELF_CRAFTED))
+        ChallengeModePlayerData* data = ChallengeModes::GetPlayerData(player);
+        if (data && !data->record.enabledTime)
         {
-            AddGossipItemFor(player, GOSSIP_ICON_CHAT, "Enable Iron Man Mode", 0, SETTING_IRON_MAN);
+            data->record.enabledTime = GameTime::GetGameTime().count();
+            sChallengeModes->SaveEnabledTime(player->GetGUID(), data->record.enabledTime);
+            sChallengeModesRegistry->Sync(player);
         }
-        SendGossipMenuFor(player, 12669, go->GetGUID());
-        return true;
-    }
-
-    bool OnGossipSelect(Player* player, GameObject* /*go*/, uint32 /*sender*/, uint32 action) override
-    {
-        player->UpdatePlayerSetting("mod-challenge-modes", action, 1);
         ChatHandler(player->GetSession()).PSendSysMessage("Challenge enabled.");
-        CloseGossipMenuFor(player);
+        sChallengeModes->NotifyEvent(CHALLENGE_EVENT_ENABLED, player, ChallengeMask(ChallengeModeSettings(action)));
         return true;
     }
 
@@ -983,16 +2091,40 @@ public:
 void AddSC_mod_challenge_modes()
 {
     new ChallengeModes_WorldScript();
+    new ChallengeTraceScripts();
+    new ChallengeXpScripts();
+    sChallengeModesAnnouncer->RegisterEventHandlers();
+    sChallengeModesTelemetry->RegisterEventHandlers();
     new gobject_challenge_modes();
+#if CHALLENGE_MODES_WITH_HARDCORE
     new ChallengeMode_Hardcore();
+#endif
+#if CHALLENGE_MODES_WITH_SEMI_HARDCORE
     new ChallengeMode_SemiHardcore();
+#endif
+#if CHALLENGE_MODES_WITH_SELF_CRAFTED
     new ChallengeMode_SelfCrafted();
+#endif
+#if CHALLENGE_MODES_WITH_ITEM_QUALITY_LEVEL
     new ChallengeMode_ItemQualityLevel();
+#endif
+#if CHALLENGE_MODES_WITH_SLOW_XP_GAIN
     new ChallengeMode_SlowXpGain();
+#endif
+#if CHALLENGE_MODES_WITH_VERY_SLOW_XP_GAIN
     new ChallengeMode_VerySlowXpGain();
+#endif
+#if CHALLENGE_MODES_WITH_QUEST_XP_ONLY
     new ChallengeMode_QuestXpOnly();
+#endif
+#if CHALLENGE_MODES_WITH_IRON_MAN
     new ChallengeMode_IronMan();
+#endif
+#if CHALLENGE_MODES_WITH_SELF_FOUND
+    new ChallengeMode_SelfFound();
+#endif
     new ChallengeMiscPlayerScripts();
     new ChallengeMiscScripts();
+    new ChallengeServerScripts();
     new ChallengeGuildScripts();
 }
@@ -10,22 +10,16 @@
 #include "Item.h"
 #include "ItemTemplate.h"
 #include "GameObjectAI.h"
+#include "DBCStores.h"
+#include "DatabaseEnv.h"
+#include "DataMap.h"
+#include "ChallengeItemProvenance.h"
+#include "ChallengeModesRules.h"
+#include <array>
+#include <functional>
 #include <map>
-
-
-enum ChallengeModeSettings
-{
-    SETTING_HARDCORE           = 0,
-    SETTING_SEMI_HARDCORE      = 1,
-    SETTING_SELF_CRAFTED       = 2,
-    SETTING_ITEM_QUALITY_LEVEL = 3,
-    SETTING_SLOW_XP_GAIN       = 4,
-    SETTING_VERY_SLOW_XP_GAIN  = 5,
-    SETTING_QUEST_XP_ONLY      = 6,
-    SETTING_IRON_MAN           = 7,
-    SETTING_MARK_DIRTY         = 8,
-    SETTING_MODE_MAX           = 8
-};
+#include <unordered_set>
+#include <mutex>
 
 enum AllowedProfessions
 {
@@ -34,58 +28,310 @@ enum AllowedProfessions
     BEAST_TRAINING = 5149
 };
 
+enum ChallengeFallenMode
+{
+    FALLEN_MODE_NONE     = 0, // Fallen characters stay where they died
+    FALLEN_MODE_TELEPORT = 1, // Fallen characters are moved to the configured holding location
+    FALLEN_MODE_LOGOUT   = 2  // Fallen characters are logged out
+};
+
+typedef std::unordered_map<uint8, uint32> ChallengeRewardMap;
+typedef std::unordered_map<uint8, CharTitlesEntry const*> ChallengeTitleRewardMap;
+
+// Per challenge state loaded from the config
+struct ChallengeModeConfig
+{
+    bool enabled = false;
+    float xpMultiplier = 1.0f;
+    ChallengeTitleRewardMap titleRewards;
+    ChallengeRewardMap talentRewards;
+    ChallengeRewardMap itemRewards;
+    uint32 sameChallengeInteractions = 0; // 1 << ChallengeInteraction allowed between two players with this challenge
+};
+
+// Row of character_challenge_modes
+struct ChallengeModeCharacterRecord
+{
+    uint32 enabledTime = 0; // When the first challenge was enabled
+    uint32 fallenTime = 0;
+    uint8 fallenLevel = 0;
+};
+
+// In-memory challenge state of an online character, attached to Player::CustomData when the character logs in.
+// Settings are mirrored from the player settings, the record is prefetched asynchronously when the character is selected.
+struct ChallengeModePlayerData : public DataMap::Base
+{
+    uint32 activeMask = 0;
+    bool dirty = false;
+    bool fallen = false;
+    bool recordLoaded = false;
+    ChallengeModeCharacterRecord record;
+    uint32 levelStartTime = 0; // Total played time when the current level was reached, in seconds
+    bool provenanceLoaded = false;
+    ChallengeItemProvenanceTable provenance;
+    std::vector<uint32> pendingProvenance; // Items recorded since the last save
+    bool reviving = false;                 // Resurrected by a game master, permadeath rules let it through
+    // Equipped enchantments whose bonus was applied before the no-enchantments rule applied to the character,
+    // see ChallengeModes::SyncEnchantmentBonuses. The bonus of every other enchantment was refused.
+    std::unordered_set<uint64> appliedEnchantments;
+    bool noEnchants = false; // The no-enchantments rule applied at the last SyncEnchantmentRule
+};
+
+enum ChallengeModeEvent
+{
+    CHALLENGE_EVENT_ENABLED   = 0, // A challenge was enabled at the shrine, the mask holds that challenge
+    CHALLENGE_EVENT_DEATH     = 1, // A character with enforced challenges died, the mask holds those challenges
+    CHALLENGE_EVENT_GRADUATED = 2, // A character completed a challenge by reaching level 80, the mask holds that challenge
+    CHALLENGE_EVENT_MAX
+};
 
+typedef std::function<void(Player* player, uint32 challengeMask)> ChallengeModeEventHandler;
+
+// Shrine of Challenge options offered to a player with a given active challenge mask
+struct ChallengeGossipMenu
+{
+    uint32 selectableMask = 0;
+    std::vector<ChallengeModeSettings> options;
+};
 
 class ChallengeModes
 {
 public:
     static ChallengeModes* instance();
 
-    bool challengesEnabled, hardcoreEnable, semiHardcoreEnable, selfCraftedEnable, itemQualityLevelEnable, slowXpGainEnable, verySlowXpGainEnable, questXpOnlyEnable, ironManEnable;
-    float hardcoreXpBonus, semiHardcoreXpBonus, selfCraftedXpBonus, itemQualityLevelXpBonus, questXpOnlyXpBonus;
-    std::unordered_map<uint8, uint32> hardcoreTitleRewards, semiHardcoreTitleRewards, selfCraftedTitleRewards, itemQualityLevelTitleRewards, slowXpGainTitleRewards, verySlowXpGainTitleRewards, questXpOnlyTitleRewards, ironManTitleRewards;
-    std::unordered_map<uint8, uint32> hardcoreItemRewards, semiHardcoreItemRewards, selfCraftedItemRewards, itemQualityLevelItemRewards, slowXpGainItemRewards, verySlowXpGainItemRewards, questXpOnlyItemRewards, ironManItemRewards;
-    std::unordered_map<uint8, uint32> hardcoreTalentRewards, semiHardcoreTalentRewards, selfCraftedTalentRewards, itemQualityLevelTalentRewards, slowXpGainTalentRewards, verySlowXpGainTalentRewards, questXpOnlyTalentRewards, ironManTalentRewards;
-
-    std::unordered_map<std::string, std::unordered_map<uint8, uint32>*> rewardConfigMap =
-            {
-                    { "Hardcore.TitleRewards",                &hardcoreTitleRewards          },
-                    { "SemiHardcore.TitleRewards",            &semiHardcoreTitleRewards      },
-                    { "SelfCrafted.TitleRewards",             &selfCraftedTitleRewards       },
-                    { "ItemQualityLevel.TitleRewards",        &itemQualityLevelTitleRewards  },
-                    { "SlowXpGain.TitleRewards",              &slowXpGainTitleRewards        },
-                    { "VerySlowXpGain.TitleRewards",          &verySlowXpGainTitleRewards    },
-                    { "QuestXpOnly.TitleRewards",             &questXpOnlyTitleRewards       },
-                    { "IronMan.TitleRewards",                 &ironManTitleRewards           },
-
-                    { "Hardcore.TalentRewards",               &hardcoreTalentRewards         },
-                    { "SemiHardcore.TalentRewards",           &semiHardcoreTalentRewards     },
-                    { "SelfCrafted.TalentRewards",            &selfCraftedTalentRewards      },
-                    { "ItemQualityLevel.TalentRewards",       &itemQualityLevelTalentRewards },
-                    { "SlowXpGain.TalentRewards",             &slowXpGainTalentRewards       },
-                    { "VerySlowXpGain.TalentRewards",         &verySlowXpGainTalentRewards   },
-                    { "QuestXpOnly.TalentRewards",            &questXpOnlyTalentRewards      },
-                    { "IronMan.TalentRewards",                &ironManTalentRewards          },
-
-                    { "Hardcore.ItemRewards",                 &hardcoreItemRewards           },
-                    { "SemiHardcore.ItemRewards",             &semiHardcoreItemRewards       },
-                    { "SelfCrafted.ItemRewards",              &selfCraftedItemRewards        },
-                    { "ItemQualityLevel.ItemRewards",         &itemQualityLevelItemRewards   },
-                    { "SlowXpGain.ItemRewards",               &slowXpGainItemRewards         },
-                    { "VerySlowXpGain.ItemRewards",           &verySlowXpGainItemRewards     },
-                    { "QuestXpOnly.ItemRewards",              &questXpOnlyItemRewards        },
-                    { "IronMan.ItemRewards",                  &ironManItemRewards            },
-            };
+    bool challengesEnabled = false;
+    uint32 enabledChallengeMask = 0; // Challenges enabled in the config, 0 when the module is disabled
+    std::array<ChallengeModeConfig, SETTING_MODE_MAX> challenges;
+    std::array<ChallengeGossipMenu, CHALLENGE_MASK_COUNT> gossipMenus;
+    // Interactions restricted by an enabled or shadowed challenge, the hooks of the others return immediately
+    std::array<bool, CHALLENGE_INTERACTION_MAX> interactionRestricted = {};
+    // Indexed by interaction, then initiator mask * CHALLENGE_MASK_COUNT + target mask, see BuildInteractionPolicy
+    std::array<std::array<ChallengeInteractionVerdict, CHALLENGE_MASK_COUNT * CHALLENGE_MASK_COUNT>, CHALLENGE_INTERACTION_MAX> interactionPolicy = {};
+
+    ChallengeFallenMode fallenMode = FALLEN_MODE_NONE;
+    uint32 fallenGraceTime = 0;
+    uint32 fallenMapId = 0;
+    float fallenPositionX = 0.0f, fallenPositionY = 0.0f, fallenPositionZ = 0.0f, fallenOrientation = 0.0f;
+
+    [[nodiscard]] static constexpr ChallengeModeDescriptor const& descriptor(ChallengeModeSettings setting) { return ChallengeModeDescriptors[setting]; }
 
     [[nodiscard]] bool enabled() const { return challengesEnabled; }
-    [[nodiscard]] bool challengeEnabled(ChallengeModeSettings setting) const;
-    [[nodiscard]] float getXpBonusForChallenge(ChallengeModeSettings setting) const;
-    bool challengeEnabledForPlayer(ChallengeModeSettings setting, Player* player) const;
+    [[nodiscard]] bool challengeEnabled(ChallengeModeSettings setting) const { return descriptor(setting).compiled && challenges[setting].enabled; }
+    [[nodiscard]] float getXpBonusForChallenge(ChallengeModeSettings setting) const { return challenges[setting].xpMultiplier; }
+    // Applies the XP adjustments of all enforced challenges of the player with a single challenge mask lookup,
+    // kill for kill XP. Called by the OnGiveXP hook, once per recipient.
+    void AdjustXp(Player* player, uint32& amount, bool kill) const;
+    // Same for count recipients at once, players and amounts indexed by recipient, for modules or core patches that
+    // distribute the XP of a group or raid kill. The config is read once per call instead of once per recipient.
+    void AdjustXp(Player* const* players, uint32* amounts, size_t count, bool kill) const;
+    // Checks the config first, so hooks of disabled challenges return before looking at the player
+    [[nodiscard]] bool challengeEnabledForPlayer(ChallengeModeSettings setting, Player* player) const
+    {
+        return (enabledChallengeMask & ChallengeMask(setting)) && (GetEnforcedChallengeMask(player) & ChallengeMask(setting));
+    }
+    // Same for the rules of the challenge, which still apply to a fallen character
+    [[nodiscard]] bool challengeRestrictsPlayer(ChallengeModeSettings setting, Player* player) const
+    {
+        return (enabledChallengeMask & ChallengeMask(setting)) && (GetRestrictedChallengeMask(player) & ChallengeMask(setting));
+    }
     std::string GetChallengeNameFromEnum(uint8 value);
+    static bool ParseChallengeName(std::string_view name, ChallengeModeSettings& setting);
+    [[nodiscard]] uint32 GetActiveChallengeMask(Player* player) const
+    {
+        if (ChallengeModePlayerData const* data = GetPlayerData(player))
+        {
+            return data->activeMask;
+        }
+        return LoadActiveChallengeMask(player);
+    }
+    // Union of the ChallengeModeRuleFlags of the challenges restricting the player
+    [[nodiscard]] uint32 GetActiveRuleFlags(Player* player) const;
+    [[nodiscard]] static ChallengeModePlayerData* GetPlayerData(Player* player) { return player->CustomData.Get<ChallengeModePlayerData>("ChallengeModes"); }
+    // Writes a player setting of this module and keeps the in-memory state in sync. Challenges are written
+    // with SetChallengeSetting, which maps them to their setting index.
+    void SetPlayerSetting(Player* player, uint8 index, uint32 value);
+    void SetChallengeSetting(Player* player, ChallengeModeSettings setting, bool active) { SetPlayerSetting(player, ChallengePlayerSettingIndex(setting), active ? 1 : 0); }
+    void SaveEnabledTime(ObjectGuid guid, uint32 enabledTime);
+    void SaveFallen(ObjectGuid guid, uint32 fallenTime, uint8 fallenLevel);
+
+    // Starts loading the module state of a character that is logging in, before the Player object exists.
+    // Returns false when the character is already loading or too many loads are pending.
+    bool PrefetchPlayerData(ObjectGuid guid);
+    // Builds the in-memory state of a character from its settings and the prefetched record, never queries the DB.
+    void HydratePlayerData(Player* player);
+    void ProcessQueryCallbacks();
+    [[nodiscard]] ChallengeGossipMenu const& getGossipMenu(uint32 activeMask) const { return gossipMenus[activeMask & (CHALLENGE_MASK_COUNT - 1)]; }
     void TryMarkDirty(Player* player);
-    [[nodiscard]] const std::unordered_map<uint8, uint32> *getTitleMapForChallenge(ChallengeModeSettings setting) const;
-    [[nodiscard]] const std::unordered_map<uint8, uint32> *getTalentMapForChallenge(ChallengeModeSettings setting) const;
-    [[nodiscard]] const std::unordered_map<uint8, uint32> *getItemMapForChallenge(ChallengeModeSettings setting) const;
+    // Answers CanApplyEnchantment for a character under the no-enchantments rule: applying is refused, removing
+    // only allowed for bonuses that were applied, so a bonus is never removed twice. Before the state of the
+    // character is built at login everything is let through, the bonuses are recorded once it is.
+    bool CanApplyEnchantment(Player* player, Item* item, EnchantmentSlot slot, bool apply);
+    // Calls SyncEnchantmentBonuses when the no-enchantments rule started or stopped applying to an online character
+    // since the last call. Runs when the state is built, when a challenge setting changes and after a config load.
+    void SyncEnchantmentRule(Player* player);
+    // SyncEnchantmentRule for every online challenge character
+    void SyncEnchantmentRules();
+    // Starting records the bonuses applied until then, stopping applies the bonuses that were refused.
+    void SyncEnchantmentBonuses(Player* player, bool ruleApplies);
+    [[nodiscard]] bool isFallen(Player* player) const
+    {
+        if (ChallengeModePlayerData const* data = GetPlayerData(player))
+        {
+            return data->fallen;
+        }
+        return player->GetPlayerSetting("mod-challenge-modes", PLAYER_SETTING_FALLEN).value == 1;
+    }
+    // Flags a dead character with a permadeath challenge as fallen, returns true if the character is fallen afterwards.
+    bool TryMarkFallen(Player* player);
+    // Clears the fallen flag and resurrects the character, bypassing the permadeath rules. Used by .challenge revive.
+    void RevivePlayer(Player* player);
+    [[nodiscard]] bool IsReviving(Player* player) const
+    {
+        ChallengeModePlayerData const* data = GetPlayerData(player);
+        return data && data->reviving;
+    }
+    // Schedules the configured fallen action for the player once the grace time has passed.
+    void QueueFallen(Player* player);
+    void UpdateFallen(uint32 diff);
+    [[nodiscard]] const ChallengeTitleRewardMap *getTitleMapForChallenge(ChallengeModeSettings setting) const { return &challenges[setting].titleRewards; }
+    [[nodiscard]] const ChallengeRewardMap *getTalentMapForChallenge(ChallengeModeSettings setting) const { return &challenges[setting].talentRewards; }
+    [[nodiscard]] const ChallengeRewardMap *getItemMapForChallenge(ChallengeModeSettings setting) const { return &challenges[setting].itemRewards; }
+
+    /*
+     * Public API for other modules. The answers come from the in-memory state built at login, so a query is one
+     * CustomData lookup and a few bit operations; characters that are still loading fall back to their settings.
+     * Include "ChallengeModes.h" and use sChallengeModes instead of reading the "mod-challenge-modes" settings.
+     */
+    // Challenges that are active on the character, enabled in the config and not suspended by the character having fallen
+    [[nodiscard]] uint32 GetEnforcedChallengeMask(Player* player) const
+    {
+        if (!enabledChallengeMask)
+        {
+            return 0;
+        }
+        if (ChallengeModePlayerData const* data = GetPlayerData(player))
+        {
+            return data->fallen ? 0 : (data->activeMask & enabledChallengeMask);
+        }
+        return isFallen(player) ? 0 : (LoadActiveChallengeMask(player) & enabledChallengeMask);
+    }
+    // Challenges whose rules apply to the character: active and enabled in the config. Falling only stops the XP
+    // and rewards of the challenges, the character keeps its gear, item and interaction restrictions.
+    [[nodiscard]] uint32 GetRestrictedChallengeMask(Player* player) const
+    {
+        if (!enabledChallengeMask)
+        {
+            return 0;
+        }
+        return GetActiveChallengeMask(player) & enabledChallengeMask;
+    }
+    [[nodiscard]] bool IsChallengeActive(Player* player, ChallengeModeSettings setting) const { return challengeEnabledForPlayer(setting, player); }
+    // True once the character looted, traded or earned anything, which makes it ineligible to enable challenges
+    [[nodiscard]] bool IsDirty(Player* player) const
+    {
+        if (ChallengeModePlayerData const* data = GetPlayerData(player))
+        {
+            return data->dirty;
+        }
+        return player->GetPlayerSetting("mod-challenge-modes", PLAYER_SETTING_MARK_DIRTY).value == 1;
+    }
+    [[nodiscard]] bool IsFallen(Player* player) const { return isFallen(player); }
+    // Same for characters that may be offline. Offline characters are read from the DB synchronously, so this is
+    // meant for rare interactions such as mail.
+    [[nodiscard]] uint32 GetEnforcedChallengeMask(ObjectGuid guid) const { return LoadChallengeMask(guid, false); }
+    [[nodiscard]] uint32 GetRestrictedChallengeMask(ObjectGuid guid) const { return LoadChallengeMask(guid, true); }
+
+    // Handlers must be registered while the scripts are loaded (e.g. from an AddSC function) and are invoked
+    // on the thread that triggered the event, which is usually a map update thread.
+    void RegisterEventHandler(ChallengeModeEvent event, ChallengeModeEventHandler handler) { _eventHandlers[event].push_back(std::move(handler)); }
+    void NotifyEvent(ChallengeModeEvent event, Player* player, uint32 challengeMask) const
+    {
+        for (ChallengeModeEventHandler const& handler : _eventHandlers[event])
+        {
+            handler(player, challengeMask);
+        }
+    }
+
+    // Rule checks shared by the hooks and the compliance auditor
+    static bool IsSelfCraftedItem(Player* player, Item* item);
+    static bool IsLowQualityItem(ItemTemplate const* proto);
+    static bool IsForbiddenTradeSkill(uint32 spellId);
+    static bool IsForbiddenConsumable(ItemTemplate const* proto);
+    static bool IsSelfFoundItem(Player* player, Item* item);
+    // True when the provenance of the item is known, only the case for characters with a provenance rule
+    static bool HasItemProvenance(Player* player, Item* item);
+    // False between the login and the load of the stored provenance, IsSelfFoundItem refuses every item meanwhile
+    static bool IsItemProvenanceLoaded(Player* player)
+    {
+        ChallengeModePlayerData const* data = GetPlayerData(player);
+        return data && data->provenanceLoaded;
+    }
+
+    // Item provenance of online characters, loaded after login and saved with the character
+    void RecordItemSource(Player* player, Item* item, ChallengeItemSource source);
+    // Records every item the character currently owns with the given source
+    void RecordOwnedItems(Player* player, ChallengeItemSource source);
+    void SaveItemProvenance(Player* player);
+    void LoadItemProvenance(Player* player);
+    // Mails an item reward and records it as ITEM_SOURCE_REWARD for characters with a provenance rule
+    void SendRewardItem(Player* player, uint32 itemEntry);
+    // Removes the provenance of items that no longer exist. Started at startup, then walks the stored rows in
+    // batches from the world update so no single query scans the whole table.
+    void StartProvenanceCleanup();
+    void UpdateProvenanceCleanup(uint32 diff);
+
+    // Parses and validates the reward options against the DBC and item template stores.
+    // Must run after those stores are loaded, so it is deferred to startup on the first load.
+    void LoadRewards();
+    // Caches the shrine options for every active challenge mask, must run after the enabled challenges are loaded.
+    void BuildGossipMenus();
+    // Resolves every (initiator mask, target mask) pair for every interaction, must run after the enabled
+    // challenges and their same-challenge exceptions are loaded.
+    void BuildInteractionPolicy();
+    [[nodiscard]] ChallengeInteractionVerdict GetInteractionVerdict(ChallengeInteraction interaction, uint32 initiatorMask, uint32 targetMask) const
+    {
+        return interactionPolicy[interaction][(initiatorMask & (CHALLENGE_MASK_COUNT - 1)) * CHALLENGE_MASK_COUNT + (targetMask & (CHALLENGE_MASK_COUNT - 1))];
+    }
+    [[nodiscard]] bool IsInteractionRestricted(ChallengeInteraction interaction) const { return interactionRestricted[interaction]; }
+    // Challenges whose <Challenge>.SameChallengeInteractions allow the interaction
+    [[nodiscard]] uint32 GetSameChallengeExemptMask(ChallengeInteraction interaction) const;
+    // Checks an interaction of the player with a party holding targetMask (0 for interactions without another
+    // player), tells the player why it was refused. Used by all interaction hooks.
+    bool CanInteract(Player* player, uint32 targetMask, ChallengeInteraction interaction);
+
+private:
+    // Reads the active challenges from the player settings, for characters without in-memory state yet
+    [[nodiscard]] static uint32 LoadActiveChallengeMask(Player* player);
+    [[nodiscard]] static uint64 EnchantmentKey(Item* item, EnchantmentSlot slot) { return (uint64(item->GetGUID().GetCounter()) << 8) | slot; }
+    // GetEnforcedChallengeMask or, with includeFallen, GetRestrictedChallengeMask of a character that may be offline
+    [[nodiscard]] uint32 LoadChallengeMask(ObjectGuid guid, bool includeFallen) const;
+
+    std::array<std::vector<ChallengeModeEventHandler>, CHALLENGE_EVENT_MAX> _eventHandlers;
+
+    struct PrefetchedRecord
+    {
+        bool ready = false;
+        uint32 requestTime = 0;
+        ChallengeModeCharacterRecord record;
+    };
+
+    void LoadRecord(ObjectGuid guid);
+    void OnRecordLoaded(ObjectGuid guid, QueryResult result);
+
+    std::mutex _queryLock;
+    QueryCallbackProcessor _queryProcessor;
+    std::mutex _prefetchLock;
+    std::unordered_map<ObjectGuid::LowType, PrefetchedRecord> _prefetched;
+
+    std::mutex _fallenLock;
+    std::vector<std::pair<ObjectGuid, uint32>> _fallenQueue; // Player, remaining grace time in ms
+
+    static constexpr uint32 ProvenanceCleanupBatchSize = 1000;
+    static constexpr uint32 ProvenanceCleanupInterval = 1 * IN_MILLISECONDS;
+    uint32 _provenanceCleanupEnd = 0;    // Highest item GUID stored at startup, later rows belong to new items
+    uint32 _provenanceCleanupCursor = 0; // Highest item GUID checked so far
+    uint32 _provenanceCleanupTimer = 0;
+    bool _provenanceCleanupPending = false;
 };
 
 #define sChallengeModes ChallengeModes::instance()
@@ -0,0 +1,410 @@
+/*
+ * Copyright (C) 2016+ AzerothCore <www.azerothcore.org>, released under GNU AGPL v3 license: https://github.com/azerothcore/azerothcore-wotlk/blob/master/LICENSE-AGPL3
+ */
+
+#include "ChallengeModesAdmin.h"
+#include "ChallengeModesRegistry.h"
+#include "GameTime.h"
+#include "ObjectAccessor.h"
+#include "StringConvert.h"
+#include "Tokenize.h"
+
+namespace
+{
+    // Characters listed per request, the others are only counted
+    constexpr uint32 MaxListed = 50;
+
+    // Values of the "mod-challenge-modes" player settings, as stored in character_settings.data
+    std::vector<uint32> ParseSettings(std::string const& data)
+    {
+        std::vector<uint32> settings;
+        for (std::string_view token : Acore::Tokenize(data, ' ', false))
+        {
+            settings.push_back(Acore::StringTo<uint32>(token).value_or(0));
+        }
+        if (settings.size() <= PLAYER_SETTING_REVIVE)
+        {
+            settings.resize(PLAYER_SETTING_REVIVE + 1, 0);
+        }
+        return settings;
+    }
+
+    std::string JoinSettings(std::vector<uint32> const& settings)
+    {
+        std::string data;
+        for (uint32 value : settings)
+        {
+            data += std::to_string(value);
+            data += ' ';
+        }
+        return data;
+    }
+
+    ChallengeAdminCharacterState ReadState(std::vector<uint32> const& settings)
+    {
+        ChallengeAdminCharacterState state;
+        for (uint8 i = 0; i < SETTING_MODE_MAX; ++i)
+        {
+            if (settings[ChallengePlayerSettingIndex(ChallengeModeSettings(i))] == 1)
+            {
+                state.activeMask |= ChallengeMask(ChallengeModeSettings(i));
+            }
+        }
+        state.dirty = settings[PLAYER_SETTING_MARK_DIRTY] == 1;
+        state.fallen = settings[PLAYER_SETTING_FALLEN] == 1;
+        return state;
+    }
+
+    ChallengeAdminCharacterState ReadState(Player* player)
+    {
+        ChallengeAdminCharacterState state;
+        state.activeMask = sChallengeModes->GetActiveChallengeMask(player);
+        state.dirty = sChallengeModes->IsDirty(player);
+        state.fallen = sChallengeModes->isFallen(player);
+        state.dead = !player->IsAlive();
+        return state;
+    }
+
+    // Fallen characters, and ghosts that died with a permadeath challenge before the fallen flag existed
+    bool NeedsRevive(ChallengeAdminCharacterState const& state)
+    {
+        return state.fallen || (state.dead && (state.activeMask & ChallengeRuleMask(CHALLENGE_RULE_PERMADEATH)));
+    }
+
+    // Challenges of the request that can be enabled on top of activeMask. Challenges disabled in the config or
+    // compiled out are never settable, the character would carry a challenge that the shrine cannot offer.
+    uint32 GetSettableMask(uint32 activeMask, uint32 requestedMask)
+    {
+        requestedMask &= sChallengeModes->enabledChallengeMask;
+
+        uint32 settable = 0;
+        for (uint8 i = 0; i < SETTING_MODE_MAX; ++i)
+        {
+            auto setting = ChallengeModeSettings(i);
+            uint32 mask = ChallengeMask(setting);
+            if ((requestedMask & mask) && !(activeMask & mask) && !((activeMask | settable) & ChallengeConflictMatrix[setting]))
+            {
+                settable |= mask;
+            }
+        }
+        return settable;
+    }
+}
+
+ChallengeModesAdmin* ChallengeModesAdmin::instance()
+{
+    static ChallengeModesAdmin instance;
+    return &instance;
+}
+
+char const* ChallengeModesAdmin::GetActionName(ChallengeAdminAction action)
+{
+    switch (action)
+    {
+        case ADMIN_ACTION_LIST:       return "list";
+        case ADMIN_ACTION_SET:        return "set";
+        case ADMIN_ACTION_CLEAR:      return "clear";
+        case ADMIN_ACTION_REVIVE:     return "revive";
+        case ADMIN_ACTION_MARK_CLEAN: return "markclean";
+        default:                      return "unknown";
+    }
+}
+
+void ChallengeModesAdmin::Run(ChallengeAdminRequest const& request)
+{
+    std::string condition;
+    switch (request.target)
+    {
+        case ADMIN_TARGET_ACCOUNT:
+            condition = Acore::StringFormatFmt("c.account = {}", request.targetId);
+            break;
+        case ADMIN_TARGET_GUILD:
+            condition = Acore::StringFormatFmt("c.guid IN (SELECT guid FROM guild_member WHERE guildid = {})", request.targetId);
+            break;
+        case ADMIN_TARGET_FALLEN:
+            condition = Acore::StringFormatFmt("m.fallen_time >= {}", request.targetId);
+            break;
+        default:
+            condition = Acore::StringFormatFmt("c.guid = {}", request.targetId);
+            break;
+    }
+
+    _queryProcessor.AddCallback(CharacterDatabase.AsyncQuery(Acore::StringFormatFmt(
+        "SELECT c.guid, c.name, c.level, s.data, c.playerFlags, c.health FROM characters c "
+        "LEFT JOIN character_settings s ON s.guid = c.guid AND s.source = 'mod-challenge-modes' "
+        "LEFT JOIN character_challenge_modes m ON m.guid = c.guid "
+        "WHERE {} AND c.deleteDate IS NULL", condition))
+        .WithCallback([this, request](QueryResult result) { Apply(request, result); }));
+}
+
+void ChallengeModesAdmin::Apply(ChallengeAdminRequest const& request, QueryResult queryResult)
+{
+    Result result;
+    CharacterDatabaseTransaction trans = CharacterDatabase.BeginTransaction();
+    bool dbWrite = false;
+
+    bool const filtered = request.action != ADMIN_ACTION_SET && request.action != ADMIN_ACTION_CLEAR && request.challengeMask;
+    if (queryResult)
+    {
+        do
+        {
+            Field* fields = queryResult->Fetch();
+            ObjectGuid::LowType guid = fields[0].Get<uint32>();
+            std::string name = fields[1].Get<std::string>();
+            uint8 level = fields[2].Get<uint8>();
+
+            // The row of an online character may be older than its in-memory state, which is saved with the character
+            Player* player = ObjectAccessor::FindConnectedPlayer(ObjectGuid::Create<HighGuid::Player>(guid));
+            std::vector<uint32> settings;
+            ChallengeAdminCharacterState state;
+            if (player)
+            {
+                state = ReadState(player);
+                level = player->GetLevel();
+            }
+            else
+            {
+                settings = ParseSettings(fields[3].IsNull() ? "" : fields[3].Get<std::string>());
+                state = ReadState(settings);
+                state.dead = (fields[4].Get<uint32>() & PLAYER_FLAGS_GHOST) || !fields[5].Get<uint32>();
+            }
+
+            if (filtered && !(state.activeMask & request.challengeMask))
+            {
+                continue;
+            }
+            ++result.matched;
+
+            if (request.action == ADMIN_ACTION_LIST)
+            {
+                if (result.lines.size() < MaxListed)
+                {
+                    result.lines.push_back(Acore::StringFormatFmt("{} - level {}{}{}{} - {}", name, level, player ? " (online)" : "",
+                        state.fallen ? " (fallen)" : "", state.dirty ? " (dirty)" : "", DescribeMask(state.activeMask)));
+                }
+                continue;
+            }
+
+            bool changed = player ? ApplyOnline(request, player, state, trans, dbWrite, result) : ApplyOffline(request, guid, state, settings, trans, dbWrite, result);
+            if (changed)
+            {
+                ++result.changed;
+            }
+        } while (queryResult->NextRow());
+    }
+
+    if (dbWrite)
+    {
+        CharacterDatabase.CommitTransaction(trans);
+    }
+
+    Reply(request.requester, Acore::StringFormatFmt("Challenge {}: {} character(s) matched, {} changed, {} skipped.",
+        GetActionName(request.action), result.matched, result.changed, result.skipped));
+    if (uint32 disabledMask = request.action == ADMIN_ACTION_SET ? request.challengeMask & ~sChallengeModes->enabledChallengeMask : 0)
+    {
+        Reply(request.requester, Acore::StringFormatFmt("{} disabled in the config, not enabled on any character.", DescribeMask(disabledMask)));
+    }
+    for (std::string const& line : result.lines)
+    {
+        Reply(request.requester, line);
+    }
+    if (request.action == ADMIN_ACTION_LIST && result.matched > MaxListed)
+    {
+        Reply(request.requester, Acore::StringFormatFmt("Only the first {} are listed.", MaxListed));
+    }
+}
+
+bool ChallengeModesAdmin::ApplyOnline(ChallengeAdminRequest const& request, Player* player, ChallengeAdminCharacterState const& state, CharacterDatabaseTransaction trans, bool& dbWrite, Result& result)
+{
+    ObjectGuid::LowType guid = player->GetGUID().GetCounter();
+
+    switch (request.action)
+    {
+        case ADMIN_ACTION_SET:
+        {
+            uint32 settable = GetSettableMask(state.activeMask, request.challengeMask);
+            if (settable != (request.challengeMask & ~state.activeMask))
+            {
+                ++result.skipped;
+            }
+            if (!settable)
+            {
+                return false;
+            }
+
+            bool recordOwnedItems = false;
+            for (uint8 i = 0; i < SETTING_MODE_MAX; ++i)
+            {
+                auto setting = ChallengeModeSettings(i);
+                if (settable & ChallengeMask(setting))
+                {
+                    sChallengeModes->SetChallengeSetting(player, setting, true);
+                    recordOwnedItems |= (ChallengeModes::descriptor(setting).ruleFlags & CHALLENGE_PROVENANCE_RULES) != 0;
+                }
+            }
+            // Unlike at the shrine the character may not be fresh, its current items are accepted as starting items
+            if (recordOwnedItems)
+            {
+                sChallengeModes->RecordOwnedItems(player, ITEM_SOURCE_STARTING);
+            }
+
+            ChallengeModePlayerData* data = ChallengeModes::GetPlayerData(player);
+            if (data && !data->record.enabledTime)
+            {
+                data->record.enabledTime = GameTime::GetGameTime().count();
+                sChallengeModesRegistry->Sync(player);
+            }
+            trans->Append("INSERT INTO character_challenge_modes (guid, enabled_time) VALUES ({}, {}) ON DUPLICATE KEY UPDATE enabled_time = IF(enabled_time = 0, VALUES(enabled_time), enabled_time)",
+                guid, GameTime::GetGameTime().count());
+            dbWrite = true;
+
+            ChatHandler(player->GetSession()).PSendSysMessage("A game master enabled %s on your character.", DescribeMask(settable).c_str());
+            sChallengeModes->NotifyEvent(CHALLENGE_EVENT_ENABLED, player, settable);
+            return true;
+        }
+        case ADMIN_ACTION_CLEAR:
+        {
+            uint32 cleared = state.activeMask & request.challengeMask;
+            if (!cleared)
+            {
+                return false;
+            }
+
+            for (uint8 i = 0; i < SETTING_MODE_MAX; ++i)
+            {
+                if (cleared & ChallengeMask(ChallengeModeSettings(i)))
+                {
+                    sChallengeModes->SetChallengeSetting(player, ChallengeModeSettings(i), false);
+                }
+            }
+            ChatHandler(player->GetSession()).PSendSysMessage("A game master disabled %s on your character.", DescribeMask(cleared).c_str());
+            return true;
+        }
+        case ADMIN_ACTION_REVIVE:
+            if (!NeedsRevive(state))
+            {
+                return false;
+            }
+            sChallengeModes->RevivePlayer(player);
+            trans->Append("UPDATE character_challenge_modes SET fallen_time = 0, fallen_level = 0 WHERE guid = {}", guid);
+            dbWrite = true;
+            ChatHandler(player->GetSession()).SendSysMessage("A game master has revived your character.");
+            return true;
+        case ADMIN_ACTION_MARK_CLEAN:
+            if (!state.dirty)
+            {
+                return false;
+            }
+            sChallengeModes->SetPlayerSetting(player, PLAYER_SETTING_MARK_DIRTY, 0);
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool ChallengeModesAdmin::ApplyOffline(ChallengeAdminRequest const& request, ObjectGuid::LowType guid, ChallengeAdminCharacterState const& state, std::vector<uint32>& settings, CharacterDatabaseTransaction trans, bool& dbWrite, Result& result)
+{
+
+    switch (request.action)
+    {
+        case ADMIN_ACTION_SET:
+        {
+            uint32 settable = GetSettableMask(state.activeMask, request.challengeMask);
+            if (settable != (request.challengeMask & ~state.activeMask))
+            {
+                ++result.skipped;
+            }
+            if (!settable)
+            {
+                return false;
+            }
+
+            bool recordOwnedItems = false;
+            for (uint8 i = 0; i < SETTING_MODE_MAX; ++i)
+            {
+                auto setting = ChallengeModeSettings(i);
+                if (settable & ChallengeMask(setting))
+                {
+                    settings[ChallengePlayerSettingIndex(setting)] = 1;
+                    recordOwnedItems |= (ChallengeModes::descriptor(setting).ruleFlags & CHALLENGE_PROVENANCE_RULES) != 0;
+                }
+            }
+            if (recordOwnedItems)
+            {
+                trans->Append("INSERT IGNORE INTO character_challenge_item_provenance (item_guid, owner_guid, source) SELECT item, guid, {} FROM character_inventory WHERE guid = {}",
+                    uint32(ITEM_SOURCE_STARTING), guid);
+            }
+            trans->Append("INSERT INTO character_challenge_modes (guid, enabled_time) VALUES ({}, {}) ON DUPLICATE KEY UPDATE enabled_time = IF(enabled_time = 0, VALUES(enabled_time), enabled_time)",
+                guid, GameTime::GetGameTime().count());
+            break;
+        }
+        case ADMIN_ACTION_CLEAR:
+        {
+            uint32 cleared = state.activeMask & request.challengeMask;
+            if (!cleared)
+            {
+                return false;
+            }
+
+            for (uint8 i = 0; i < SETTING_MODE_MAX; ++i)
+            {
+                if (cleared & ChallengeMask(ChallengeModeSettings(i)))
+                {
+                    settings[ChallengePlayerSettingIndex(ChallengeModeSettings(i))] = 0;
+                }
+            }
+            break;
+        }
+        case ADMIN_ACTION_REVIVE:
+            if (!NeedsRevive(state))
+            {
+                return false;
+            }
+            // The character may be a ghost without being flagged fallen yet, so it is resurrected at its next login either way
+            settings[PLAYER_SETTING_FALLEN] = 0;
+            settings[PLAYER_SETTING_REVIVE] = 1;
+            trans->Append("UPDATE character_challenge_modes SET fallen_time = 0, fallen_level = 0 WHERE guid = {}", guid);
+            break;
+        case ADMIN_ACTION_MARK_CLEAN:
+            if (!state.dirty)
+            {
+                return false;
+            }
+            settings[PLAYER_SETTING_MARK_DIRTY] = 0;
+            break;
+        default:
+            return false;
+    }
+
+    trans->Append("REPLACE INTO character_settings (guid, source, data) VALUES ({}, 'mod-challenge-modes', '{}')", guid, JoinSettings(settings));
+    dbWrite = true;
+    return true;
+}
+
+void ChallengeModesAdmin::Reply(ObjectGuid requester, std::string const& message)
+{
+    if (requester.IsEmpty())
+    {
+        LOG_INFO("module", "{}", message);
+        return;
+    }
+
+    if (Player* player = ObjectAccessor::FindConnectedPlayer(requester))
+    {
+        ChatHandler(player->GetSession()).SendSysMessage(message);
+    }
+}
+
+std::string ChallengeModesAdmin::DescribeMask(uint32 challengeMask)
+{
+    std::string challenges;
+    for (uint8 i = 0; i < SETTING_MODE_MAX; ++i)
+    {
+        if (challengeMask & ChallengeMask(ChallengeModeSettings(i)))
+        {
+            challenges += challenges.empty() ? "" : ", ";
+            challenges += ChallengeModeDescriptors[i].name;
+        }
+    }
+    return challenges.empty() ? "no challenge" : challenges;
+}
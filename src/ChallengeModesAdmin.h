@@ -0,0 +1,80 @@
+#ifndef AZEROTHCORE_CHALLENGEMODESADMIN_H
+#define AZEROTHCORE_CHALLENGEMODESADMIN_H
+
+#include "ChallengeModes.h"
+#include "QueryCallback.h"
+
+enum ChallengeAdminAction
+{
+    ADMIN_ACTION_LIST       = 0,
+    ADMIN_ACTION_SET        = 1, // Enables the challenges of the request, skipping characters with a conflicting challenge
+    ADMIN_ACTION_CLEAR      = 2,
+    ADMIN_ACTION_REVIVE     = 3, // Clears the fallen flag and resurrects the character, now or at its next login
+    ADMIN_ACTION_MARK_CLEAN = 4, // Clears the dirty flag so challenges can be selected at the shrine again
+    ADMIN_ACTION_MAX
+};
+
+enum ChallengeAdminTarget
+{
+    ADMIN_TARGET_CHARACTER = 0, // targetId is the character GUID
+    ADMIN_TARGET_ACCOUNT   = 1, // targetId is the account ID
+    ADMIN_TARGET_GUILD     = 2, // targetId is the guild ID
+    ADMIN_TARGET_FALLEN    = 3  // targetId is a unix time, characters that have fallen since then
+};
+
+struct ChallengeAdminRequest
+{
+    ChallengeAdminAction action = ADMIN_ACTION_LIST;
+    ChallengeAdminTarget target = ADMIN_TARGET_CHARACTER;
+    uint32 targetId = 0;
+    // Challenges to set or clear. For the other actions, only characters with one of them active are affected (0 for all).
+    uint32 challengeMask = 0;
+    ObjectGuid requester; // Receives the result, empty for the console
+};
+
+// Challenge state of a character read from memory when online, from its settings otherwise
+struct ChallengeAdminCharacterState
+{
+    uint32 activeMask = 0;
+    bool dirty = false;
+    bool fallen = false;
+    bool dead = false;
+};
+
+/*
+ * GM administration of the challenge state of online and offline characters. A request resolves its characters
+ * with one asynchronous query, then writes every offline change in one transaction. Online characters are changed
+ * in memory like the shrine does and saved with the character, so their state never lags behind the DB.
+ */
+class ChallengeModesAdmin
+{
+public:
+    static ChallengeModesAdmin* instance();
+
+    void Run(ChallengeAdminRequest const& request);
+    void ProcessQueryCallbacks() { _queryProcessor.ProcessReadyCallbacks(); }
+
+    [[nodiscard]] static char const* GetActionName(ChallengeAdminAction action);
+
+private:
+    struct Result
+    {
+        uint32 matched = 0;
+        uint32 changed = 0;
+        uint32 skipped = 0; // Characters that could not take the change, e.g. because of a conflicting challenge
+        std::vector<std::string> lines;
+    };
+
+    void Apply(ChallengeAdminRequest const& request, QueryResult queryResult);
+    // Both return true when the character was changed, and set dbWrite when they appended to the transaction
+    bool ApplyOnline(ChallengeAdminRequest const& request, Player* player, ChallengeAdminCharacterState const& state, CharacterDatabaseTransaction trans, bool& dbWrite, Result& result);
+    bool ApplyOffline(ChallengeAdminRequest const& request, ObjectGuid::LowType guid, ChallengeAdminCharacterState const& state, std::vector<uint32>& settings, CharacterDatabaseTransaction trans, bool& dbWrite, Result& result);
+    static void Reply(ObjectGuid requester, std::string const& message);
+    static std::string DescribeMask(uint32 challengeMask);
+
+    QueryCallbackProcessor _queryProcessor;
+};
+
+#define sChallengeModesAdmin ChallengeModesAdmin::instance()
+
+#endif //AZEROTHCORE_CHALLENGEMODESADMIN_H
@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2016+ AzerothCore <www.azerothcore.org>, released under GNU AGPL v3 license: https://github.com/azerothcore/azerothcore-wotlk/blob/master/LICENSE-AGPL3
+ */
+
+#include "ChallengeModesAnnouncer.h"
+#include "Guild.h"
+#include "GuildMgr.h"
+#include "World.h"
+#include "WorldPacket.h"
+
+ChallengeModesAnnouncer* ChallengeModesAnnouncer::instance()
+{
+    static ChallengeModesAnnouncer instance;
+    return &instance;
+}
+
+void ChallengeModesAnnouncer::RegisterEventHandlers()
+{
+    sChallengeModes->RegisterEventHandler(CHALLENGE_EVENT_DEATH, [this](Player* player, uint32 challengeMask) { Queue(CHALLENGE_EVENT_DEATH, player, challengeMask); });
+    sChallengeModes->RegisterEventHandler(CHALLENGE_EVENT_GRADUATED, [this](Player* player, uint32 challengeMask) { Queue(CHALLENGE_EVENT_GRADUATED, player, challengeMask); });
+}
+
+void ChallengeModesAnnouncer::Queue(ChallengeModeEvent event, Player* player, uint32 challengeMask)
+{
+    challengeMask &= CHALLENGE_ANNOUNCE_MASK;
+    if (channel == ANNOUNCE_CHANNEL_NONE || !challengeMask)
+    {
+        return;
+    }
+
+    uint32 guildId = 0;
+    if (channel == ANNOUNCE_CHANNEL_GUILD)
+    {
+        guildId = player->GetGuildId();
+        if (!guildId)
+        {
+            return;
+        }
+    }
+
+    // A character is announced under its first announced challenge only
+    uint8 challenge = 0;
+    while (!(challengeMask & ChallengeMask(ChallengeModeSettings(challenge))))
+    {
+        ++challenge;
+    }
+
+    uint32 zoneId = event == CHALLENGE_EVENT_DEATH ? player->GetZoneId() : 0;
+
+    std::lock_guard<std::mutex> guard(_lock);
+    Announcement& announcement = _pending[AnnouncementKey(event, challenge, guildId, zoneId)];
+    if (!announcement.count)
+    {
+        announcement.level = player->GetLevel();
+    }
+    ++announcement.count;
+    if (announcement.names.size() < MaxNamesListed)
+    {
+        announcement.names.push_back(player->GetName());
+    }
+}
+
+void ChallengeModesAnnouncer::Update(uint32 diff)
+{
+    if (_timer > diff)
+    {
+        _timer -= diff;
+        return;
+    }
+    _timer = interval;
+
+    std::map<AnnouncementKey, Announcement> pending;
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        if (_pending.empty())
+        {
+            return;
+        }
+        pending.swap(_pending);
+    }
+
+    // The limit applies per audience: the world channel, or each guild. Announcements over it are summarized in
+    // one line for the same audience, so nobody receives more than maxMessages + 1 lines per interval.
+    std::map<uint32, std::pair<uint32, uint32>> audiences; // Guild (0 for the world channel), sent and summarized announcements
+    for (auto const& [key, announcement] : pending)
+    {
+        auto& [sent, suppressed] = audiences[std::get<2>(key)];
+        if (sent < maxMessages)
+        {
+            Send(BuildText(key, announcement), std::get<2>(key));
+            ++sent;
+        }
+        else
+        {
+            suppressed += announcement.count;
+        }
+    }
+
+    for (auto const& [guildId, counts] : audiences)
+    {
+        if (counts.second)
+        {
+            Send(Acore::StringFormatFmt("Challenge Modes: {} more heroes have fallen or completed their challenge.", counts.second), guildId);
+        }
+    }
+}
+
+static std::string GetZoneName(uint32 zoneId)
+{
+    if (AreaTableEntry const* area = sAreaTableStore.LookupEntry(zoneId))
+    {
+        return area->area_name[sWorld->GetDefaultDbcLocale()];
+    }
+    return "an unknown place";
+}
+
+std::string ChallengeModesAnnouncer::BuildText(AnnouncementKey const& key, Announcement const& announcement)
+{
+    uint8 event = std::get<0>(key);
+    uint32 zoneId = std::get<3>(key);
+    std::string challengeName = ChallengeModeDescriptors[std::get<1>(key)].name;
+
+    if (announcement.count == 1)
+    {
+        if (event == CHALLENGE_EVENT_GRADUATED)
+        {
+            return Acore::StringFormatFmt("{}: {} has completed the challenge at level {}!", challengeName, announcement.names[0], announcement.level);
+        }
+
+        return Acore::StringFormatFmt("{}: {} has fallen at level {} in {}.", challengeName, announcement.names[0], announcement.level, GetZoneName(zoneId));
+    }
+
+    std::string names;
+    for (std::string const& name : announcement.names)
+    {
+        names += names.empty() ? "" : ", ";
+        names += name;
+    }
+    if (announcement.count > announcement.names.size())
+    {
+        names += Acore::StringFormatFmt(" and {} more", announcement.count - announcement.names.size());
+    }
+
+    if (event == CHALLENGE_EVENT_GRADUATED)
+    {
+        return Acore::StringFormatFmt("{}: {} heroes have completed the challenge: {}!", challengeName, announcement.count, names);
+    }
+
+    return Acore::StringFormatFmt("{}: {} heroes have fallen in {}: {}.", challengeName, announcement.count, GetZoneName(zoneId), names);
+}
+
+void ChallengeModesAnnouncer::Send(std::string const& text, uint32 guildId)
+{
+    // The packet is built once and shared by all recipients
+    WorldPacket data;
+    ChatHandler::BuildChatPacket(data, CHAT_MSG_SYSTEM, LANG_UNIVERSAL, nullptr, nullptr, text);
+
+    if (!guildId)
+    {
+        sWorld->SendGlobalMessage(&data);
+        return;
+    }
+
+    if (Guild* guild = sGuildMgr->GetGuildById(guildId))
+    {
+        guild->BroadcastPacket(&data);
+    }
+}
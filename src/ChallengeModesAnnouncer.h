@@ -0,0 +1,63 @@
+#ifndef AZEROTHCORE_CHALLENGEMODESANNOUNCER_H
+#define AZEROTHCORE_CHALLENGEMODESANNOUNCER_H
+
+#include "ChallengeModes.h"
+#include <map>
+#include <mutex>
+#include <tuple>
+
+enum ChallengeAnnounceChannel
+{
+    ANNOUNCE_CHANNEL_NONE  = 0,
+    ANNOUNCE_CHANNEL_WORLD = 1,
+    ANNOUNCE_CHANNEL_GUILD = 2
+};
+
+// Challenges whose deaths and graduations are announced
+constexpr uint32 CHALLENGE_ANNOUNCE_MASK = ChallengeRuleMask(CHALLENGE_RULE_PERMADEATH);
+
+/*
+ * Announces deaths and graduations of permadeath challenge characters. Events are raised on the map threads and
+ * only merged into the pending announcements there; the world thread sends them once per interval. Events with
+ * the same challenge, channel and zone become one message, each message is built into a single packet for all
+ * recipients, and at most maxMessages are sent per interval and audience (the world, or a guild) before the rest
+ * is summarized in one line, so the fan-out does not grow with the number of deaths.
+ */
+class ChallengeModesAnnouncer
+{
+public:
+    static ChallengeModesAnnouncer* instance();
+
+    ChallengeAnnounceChannel channel = ANNOUNCE_CHANNEL_NONE;
+    uint32 interval = 5000;  // Milliseconds between two flushes of the pending announcements
+    uint32 maxMessages = 3;  // Messages per flush and audience, further announcements are summarized in one line
+
+    // Subscribes to the challenge events, must be called while the scripts are loaded
+    void RegisterEventHandlers();
+    void Update(uint32 diff);
+
+private:
+    static constexpr uint32 MaxNamesListed = 5;
+
+    struct Announcement
+    {
+        uint32 count = 0;
+        uint8 level = 0;                // Level of the first character, shown when there is only one
+        std::vector<std::string> names; // First MaxNamesListed characters
+    };
+
+    // Event, challenge, guild (0 for the world channel), zone (0 for graduations)
+    typedef std::tuple<uint8, uint8, uint32, uint32> AnnouncementKey;
+
+    void Queue(ChallengeModeEvent event, Player* player, uint32 challengeMask);
+    static std::string BuildText(AnnouncementKey const& key, Announcement const& announcement);
+    static void Send(std::string const& text, uint32 guildId);
+
+    std::mutex _lock;
+    std::map<AnnouncementKey, Announcement> _pending;
+    uint32 _timer = 0;
+};
+
+#define sChallengeModesAnnouncer ChallengeModesAnnouncer::instance()
+
+#endif //AZEROTHCORE_CHALLENGEMODESANNOUNCER_H
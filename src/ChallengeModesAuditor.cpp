@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2016+ AzerothCore <www.azerothcore.org>, released under GNU AGPL v3 license: https://github.com/azerothcore/azerothcore-wotlk/blob/master/LICENSE-AGPL3
+ */
+
+#include "ChallengeModesAuditor.h"
+#include "ChallengeModesRegistry.h"
+#include "Mail.h"
+#include "ObjectAccessor.h"
+#include "Timer.h"
+#include <chrono>
+
+ChallengeModesAuditor* ChallengeModesAuditor::instance()
+{
+    static ChallengeModesAuditor instance;
+    return &instance;
+}
+
+void ChallengeModesAuditor::StartCycle()
+{
+    // The registry holds exactly the online challenge players and is safe to read from the world thread, unlike
+    // the session player map which other threads change. Fallen characters keep their restrictions.
+    _queue.clear();
+    _cursor = 0;
+    for (ChallengeRegistryEntry const& entry : sChallengeModesRegistry->Find(0, true))
+    {
+        _queue.push_back(ObjectGuid::Create<HighGuid::Player>(entry.guid));
+    }
+
+    _stats.cycleSize = _queue.size();
+    _stats.cyclePosition = 0;
+    _cycleStartTime = getMSTime();
+}
+
+void ChallengeModesAuditor::Update(uint32 diff)
+{
+    if (!auditEnabled || !sChallengeModes->enabled())
+    {
+        return;
+    }
+
+    if (!IsCycleRunning())
+    {
+        if (_timer > diff)
+        {
+            _timer -= diff;
+            return;
+        }
+        StartCycle();
+    }
+
+    using Clock = std::chrono::steady_clock;
+    auto const start = Clock::now();
+    auto const deadline = start + std::chrono::microseconds(budget);
+
+    CharacterDatabaseTransaction trans = CharacterDatabase.BeginTransaction();
+    bool dbWrite = false;
+
+    // At least one player is processed per tick so the cycle always makes progress
+    do
+    {
+        if (Player* player = ObjectAccessor::FindPlayer(_queue[_cursor]))
+        {
+            dbWrite |= AuditPlayer(player, trans);
+        }
+        ++_cursor;
+    } while (IsCycleRunning() && Clock::now() < deadline);
+
+    if (dbWrite)
+    {
+        CharacterDatabase.CommitTransaction(trans);
+    }
+
+    uint32 elapsed = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+    ++_stats.ticks;
+    _stats.totalTime += elapsed;
+    _stats.maxTickTime = std::max(_stats.maxTickTime, elapsed);
+    _stats.cyclePosition = _cursor;
+
+    if (!IsCycleRunning())
+    {
+        ++_stats.cycles;
+        _stats.lastCycleTime = GetMSTimeDiffToNow(_cycleStartTime);
+        _queue.clear();
+        _cursor = 0;
+        _timer = interval;
+    }
+}
+
+bool ChallengeModesAuditor::AuditPlayer(Player* player, CharacterDatabaseTransaction trans)
+{
+    if (!player->IsInWorld() || player->IsBeingTeleported())
+    {
+        return false;
+    }
+
+    uint32 ruleFlags = sChallengeModes->GetActiveRuleFlags(player) & CHALLENGE_AUDIT_RULES;
+    // Until the provenance is loaded every item would count as a violation, the next cycle audits these rules
+    if (!ChallengeModes::IsItemProvenanceLoaded(player))
+    {
+        ruleFlags &= ~CHALLENGE_PROVENANCE_RULES;
+    }
+    if (!ruleFlags)
+    {
+        return false;
+    }
+
+    ++_stats.playersAudited;
+
+    bool dbWrite = false;
+    uint32 violations = 0;
+
+    for (uint8 slot = EQUIPMENT_SLOT_START; slot < EQUIPMENT_SLOT_END; ++slot)
+    {
+        Item* item = player->GetItemByPos(INVENTORY_SLOT_BAG_0, slot);
+        if (!item)
+        {
+            continue;
+        }
+
+        if (((ruleFlags & CHALLENGE_RULE_SELF_CRAFTED_GEAR) && !ChallengeModes::IsSelfCraftedItem(player, item)) ||
+            ((ruleFlags & CHALLENGE_RULE_SELF_FOUND_GEAR) && !ChallengeModes::IsSelfFoundItem(player, item)) ||
+            ((ruleFlags & CHALLENGE_RULE_LOW_QUALITY_GEAR) && !ChallengeModes::IsLowQualityItem(item->GetTemplate())))
+        {
+            UnequipItem(player, item, trans, dbWrite);
+            ++_stats.itemsUnequipped;
+            ++violations;
+            continue;
+        }
+
+        if (ruleFlags & CHALLENGE_RULE_NO_ENCHANTS)
+        {
+            // Enchantments, gems, socket bonuses and belt buckles. The random property slots that follow are part
+            // of the item itself.
+            for (uint8 enchantSlot = PERM_ENCHANTMENT_SLOT; enchantSlot < MAX_INSPECTED_ENCHANTMENT_SLOT; ++enchantSlot)
+            {
+                if (!item->GetEnchantmentId(EnchantmentSlot(enchantSlot)))
+                {
+                    continue;
+                }
+                // Removes the bonus if it was applied before the rule applied to the player, the enchantment hook
+                // refuses the removal of the bonuses it refused
+                player->ApplyEnchantment(item, EnchantmentSlot(enchantSlot), false);
+                item->ClearEnchantment(EnchantmentSlot(enchantSlot));
+                item->SetState(ITEM_CHANGED, player);
+                ++_stats.enchantsRemoved;
+                ++violations;
+            }
+        }
+    }
+
+    if (ruleFlags & CHALLENGE_RULE_NO_TRADE_SKILLS)
+    {
+        std::vector<uint32> forbiddenSpells;
+        for (auto const& [spellId, playerSpell] : player->GetSpellMap())
+        {
+            if (playerSpell->State != PLAYERSPELL_REMOVED && ChallengeModes::IsForbiddenTradeSkill(spellId))
+            {
+                forbiddenSpells.push_back(spellId);
+            }
+        }
+
+        for (uint32 spellId : forbiddenSpells)
+        {
+            player->removeSpell(spellId, SPEC_MASK_ALL, false);
+            ++_stats.spellsRemoved;
+            ++violations;
+        }
+    }
+
+    if (violations)
+    {
+        ChatHandler(player->GetSession()).PSendSysMessage("Challenge Modes: %u item(s), enchantment(s) or trade skill(s) did not comply with your active challenges and were removed.", violations);
+    }
+
+    return dbWrite;
+}
+
+void ChallengeModesAuditor::UnequipItem(Player* player, Item* item, CharacterDatabaseTransaction trans, bool& dbWrite)
+{
+    uint8 slot = item->GetSlot();
+
+    ItemPosCountVec dest;
+    InventoryResult msg = player->CanStoreItem(NULL_BAG, NULL_SLOT, dest, item, false);
+    if (msg == EQUIP_ERR_OK)
+    {
+        player->RemoveItem(INVENTORY_SLOT_BAG_0, slot, true);
+        player->StoreItem(dest, item, true);
+        return;
+    }
+
+    // No room in the bags, mail the item like the core does for items that cannot stay equipped
+    player->MoveItemFromInventory(INVENTORY_SLOT_BAG_0, slot, true);
+    item->DeleteFromInventoryDB(trans);
+    item->SaveToDB(trans);
+    MailDraft("Challenge Modes", "This item does not comply with your active challenges and there was no room for it in your bags.")
+        .AddItem(item)
+        .SendMailTo(trans, player, MailSender(player, MAIL_STATIONERY_GM), MAIL_CHECK_MASK_COPIED);
+    dbWrite = true;
+}
@@ -0,0 +1,57 @@
+#ifndef AZEROTHCORE_CHALLENGEMODESAUDITOR_H
+#define AZEROTHCORE_CHALLENGEMODESAUDITOR_H
+
+#include "ChallengeModes.h"
+
+// Rules that can be violated by state the player acquired before the rule applied to them
+constexpr uint32 CHALLENGE_AUDIT_RULES = CHALLENGE_RULE_SELF_CRAFTED_GEAR | CHALLENGE_RULE_SELF_FOUND_GEAR | CHALLENGE_RULE_LOW_QUALITY_GEAR | CHALLENGE_RULE_NO_ENCHANTS | CHALLENGE_RULE_NO_TRADE_SKILLS;
+
+struct ChallengeAuditStats
+{
+    uint32 cycles = 0;            // Completed walks over all online challenge players
+    uint32 cyclePosition = 0;     // Players processed in the current cycle
+    uint32 cycleSize = 0;         // Challenge players online when the current cycle started
+    uint32 lastCycleTime = 0;     // Wall time of the last completed cycle, in ms
+    uint64 playersAudited = 0;    // Players with at least one auditable rule
+    uint64 itemsUnequipped = 0;
+    uint64 enchantsRemoved = 0;
+    uint64 spellsRemoved = 0;
+    uint64 ticks = 0;             // World ticks in which the auditor ran
+    uint64 totalTime = 0;         // Time spent auditing, in microseconds
+    uint32 maxTickTime = 0;       // Longest single tick, in microseconds
+};
+
+/*
+ * Re-checks online challenge players against the rules that are otherwise only enforced at event time
+ * (equipping, enchanting, learning). Runs on the world thread between map updates and processes players
+ * one by one until the per-tick time budget is used, so a full pass is spread over as many ticks as needed.
+ */
+class ChallengeModesAuditor
+{
+public:
+    static ChallengeModesAuditor* instance();
+
+    bool auditEnabled = false;
+    uint32 budget = 200;      // Microseconds per world tick
+    uint32 interval = 60000;  // Milliseconds between the end of a cycle and the start of the next one
+
+    void Update(uint32 diff);
+    [[nodiscard]] ChallengeAuditStats const& GetStats() const { return _stats; }
+    [[nodiscard]] bool IsCycleRunning() const { return _cursor < _queue.size(); }
+
+private:
+    void StartCycle();
+    // Returns true if anything was written to the transaction
+    bool AuditPlayer(Player* player, CharacterDatabaseTransaction trans);
+    void UnequipItem(Player* player, Item* item, CharacterDatabaseTransaction trans, bool& dbWrite);
+
+    std::vector<ObjectGuid> _queue;
+    size_t _cursor = 0;
+    uint32 _timer = 0;
+    uint32 _cycleStartTime = 0;
+    ChallengeAuditStats _stats;
+};
+
+#define sChallengeModesAuditor ChallengeModesAuditor::instance()
+
+#endif //AZEROTHCORE_CHALLENGEMODESAUDITOR_H
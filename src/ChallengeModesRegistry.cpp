@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2016+ AzerothCore <www.azerothcore.org>, released under GNU AGPL v3 license: https://github.com/azerothcore/azerothcore-wotlk/blob/master/LICENSE-AGPL3
+ */
+
+#include "ChallengeModesRegistry.h"
+
+ChallengeModesRegistry* ChallengeModesRegistry::instance()
+{
+    static ChallengeModesRegistry instance;
+    return &instance;
+}
+
+void ChallengeModesRegistry::Sync(Player* player)
+{
+    ChallengeModePlayerData const* data = ChallengeModes::GetPlayerData(player);
+    if (!data || !data->activeMask)
+    {
+        Remove(player->GetGUID());
+        return;
+    }
+
+    ObjectGuid::LowType guid = player->GetGUID().GetCounter();
+
+    std::unique_lock<std::shared_mutex> lock(_lock);
+    auto itr = _index.find(guid);
+    uint32 index;
+    if (itr == _index.end())
+    {
+        index = _guids.size();
+        _index[guid] = index;
+        _guids.push_back(guid);
+        _activeMasks.push_back(0);
+        _levels.push_back(0);
+        _fallen.push_back(0);
+        _enabledTimes.push_back(0);
+    }
+    else
+    {
+        index = itr->second;
+    }
+
+    _activeMasks[index] = data->activeMask;
+    _levels[index] = player->GetLevel();
+    _fallen[index] = data->fallen;
+    _enabledTimes[index] = data->record.enabledTime;
+}
+
+void ChallengeModesRegistry::UpdateLevel(Player* player)
+{
+    std::unique_lock<std::shared_mutex> lock(_lock);
+    auto itr = _index.find(player->GetGUID().GetCounter());
+    if (itr != _index.end())
+    {
+        _levels[itr->second] = player->GetLevel();
+    }
+}
+
+void ChallengeModesRegistry::Remove(ObjectGuid guid)
+{
+    std::unique_lock<std::shared_mutex> lock(_lock);
+    auto itr = _index.find(guid.GetCounter());
+    if (itr == _index.end())
+    {
+        return;
+    }
+
+    uint32 index = itr->second;
+    _index.erase(itr);
+    RemoveAt(index);
+}
+
+void ChallengeModesRegistry::RemoveAt(uint32 index)
+{
+    uint32 last = _guids.size() - 1;
+    if (index != last)
+    {
+        _guids[index] = _guids[last];
+        _activeMasks[index] = _activeMasks[last];
+        _levels[index] = _levels[last];
+        _fallen[index] = _fallen[last];
+        _enabledTimes[index] = _enabledTimes[last];
+        _index[_guids[index]] = index;
+    }
+
+    _guids.pop_back();
+    _activeMasks.pop_back();
+    _levels.pop_back();
+    _fallen.pop_back();
+    _enabledTimes.pop_back();
+}
+
+uint32 ChallengeModesRegistry::Size() const
+{
+    std::shared_lock<std::shared_mutex> lock(_lock);
+    return _guids.size();
+}
+
+uint32 ChallengeModesRegistry::Count(uint32 challengeMask, bool includeFallen) const
+{
+    uint32 const filterMask = challengeMask ? challengeMask : ~0u;
+    uint8 const fallenFilter = includeFallen ? 0 : 1;
+
+    std::shared_lock<std::shared_mutex> lock(_lock);
+    uint32 const* masks = _activeMasks.data();
+    uint8 const* fallen = _fallen.data();
+    uint32 size = _activeMasks.size();
+
+    // Branch free so the loop vectorizes
+    uint32 count = 0;
+    for (uint32 i = 0; i < size; ++i)
+    {
+        count += ((masks[i] & filterMask) != 0) & ((fallen[i] & fallenFilter) == 0);
+    }
+    return count;
+}
+
+std::vector<ChallengeRegistryEntry> ChallengeModesRegistry::Find(uint32 challengeMask, bool includeFallen, uint32 limit) const
+{
+    uint32 const filterMask = challengeMask ? challengeMask : ~0u;
+
+    std::vector<ChallengeRegistryEntry> entries;
+
+    std::shared_lock<std::shared_mutex> lock(_lock);
+    uint32 size = _activeMasks.size();
+    for (uint32 i = 0; i < size; ++i)
+    {
+        if (!(_activeMasks[i] & filterMask) || (_fallen[i] && !includeFallen))
+        {
+            continue;
+        }
+
+        entries.push_back({ _guids[i], _activeMasks[i], _levels[i], _fallen[i] != 0, _enabledTimes[i] });
+        if (limit && entries.size() >= limit)
+        {
+            break;
+        }
+    }
+    return entries;
+}
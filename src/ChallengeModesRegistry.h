@@ -0,0 +1,51 @@
+#ifndef AZEROTHCORE_CHALLENGEMODESREGISTRY_H
+#define AZEROTHCORE_CHALLENGEMODESREGISTRY_H
+
+#include "ChallengeModes.h"
+#include <shared_mutex>
+
+// Snapshot of one registry entry, returned by queries
+struct ChallengeRegistryEntry
+{
+    ObjectGuid::LowType guid;
+    uint32 activeMask;
+    uint8 level;
+    bool fallen;
+    uint32 enabledTime;
+};
+
+/*
+ * Online characters that have at least one challenge active, kept in a structure-of-arrays layout so that
+ * "every hardcore player online" style queries are a linear scan over a few contiguous arrays instead of
+ * a walk over every session. Entries are swap-removed, so the order is not stable.
+ */
+class ChallengeModesRegistry
+{
+public:
+    static ChallengeModesRegistry* instance();
+
+    // Inserts, updates or removes (when no challenge is active anymore) the entry of the player
+    void Sync(Player* player);
+    void UpdateLevel(Player* player);
+    void Remove(ObjectGuid guid);
+
+    [[nodiscard]] uint32 Size() const;
+    // Entries with any challenge of challengeMask active (all entries for 0). Fallen characters are only included when asked for.
+    [[nodiscard]] uint32 Count(uint32 challengeMask, bool includeFallen) const;
+    [[nodiscard]] std::vector<ChallengeRegistryEntry> Find(uint32 challengeMask, bool includeFallen, uint32 limit = 0) const;
+
+private:
+    void RemoveAt(uint32 index);
+
+    mutable std::shared_mutex _lock;
+    std::unordered_map<ObjectGuid::LowType, uint32> _index;
+    std::vector<ObjectGuid::LowType> _guids;
+    std::vector<uint32> _activeMasks;
+    std::vector<uint8> _levels;
+    std::vector<uint8> _fallen;
+    std::vector<uint32> _enabledTimes;
+};
+
+#define sChallengeModesRegistry ChallengeModesRegistry::instance()
+
+#endif //AZEROTHCORE_CHALLENGEMODESREGISTRY_H
@@ -0,0 +1,367 @@
+#ifndef AZEROTHCORE_CHALLENGEMODESRULES_H
+#define AZEROTHCORE_CHALLENGEMODESRULES_H
+
+#include "Define.h"
+#include <array>
+#include <cstddef>
+
+/*
+ * Challenge definitions and rule evaluation on challenge masks. Only depends on Define.h so offline tools,
+ * such as the hook trace replay in tools/trace_replay, evaluate exactly the same rules as the module.
+ */
+
+/*
+ * Build options: define CHALLENGE_MODES_DISABLE_<CHALLENGE> (e.g. -DCHALLENGE_MODES_DISABLE_IRON_MAN in
+ * CMAKE_CXX_FLAGS) to compile a challenge out of the module. Its scripts are not built or registered,
+ * its config options are ignored, and it can never be selected at the shrine.
+ */
+#ifdef CHALLENGE_MODES_DISABLE_HARDCORE
+#define CHALLENGE_MODES_WITH_HARDCORE 0
+#else
+#define CHALLENGE_MODES_WITH_HARDCORE 1
+#endif
+
+#ifdef CHALLENGE_MODES_DISABLE_SEMI_HARDCORE
+#define CHALLENGE_MODES_WITH_SEMI_HARDCORE 0
+#else
+#define CHALLENGE_MODES_WITH_SEMI_HARDCORE 1
+#endif
+
+#ifdef CHALLENGE_MODES_DISABLE_SELF_CRAFTED
+#define CHALLENGE_MODES_WITH_SELF_CRAFTED 0
+#else
+#define CHALLENGE_MODES_WITH_SELF_CRAFTED 1
+#endif
+
+#ifdef CHALLENGE_MODES_DISABLE_ITEM_QUALITY_LEVEL
+#define CHALLENGE_MODES_WITH_ITEM_QUALITY_LEVEL 0
+#else
+#define CHALLENGE_MODES_WITH_ITEM_QUALITY_LEVEL 1
+#endif
+
+#ifdef CHALLENGE_MODES_DISABLE_SLOW_XP_GAIN
+#define CHALLENGE_MODES_WITH_SLOW_XP_GAIN 0
+#else
+#define CHALLENGE_MODES_WITH_SLOW_XP_GAIN 1
+#endif
+
+#ifdef CHALLENGE_MODES_DISABLE_VERY_SLOW_XP_GAIN
+#define CHALLENGE_MODES_WITH_VERY_SLOW_XP_GAIN 0
+#else
+#define CHALLENGE_MODES_WITH_VERY_SLOW_XP_GAIN 1
+#endif
+
+#ifdef CHALLENGE_MODES_DISABLE_QUEST_XP_ONLY
+#define CHALLENGE_MODES_WITH_QUEST_XP_ONLY 0
+#else
+#define CHALLENGE_MODES_WITH_QUEST_XP_ONLY 1
+#endif
+
+#ifdef CHALLENGE_MODES_DISABLE_IRON_MAN
+#define CHALLENGE_MODES_WITH_IRON_MAN 0
+#else
+#define CHALLENGE_MODES_WITH_IRON_MAN 1
+#endif
+
+#ifdef CHALLENGE_MODES_DISABLE_SELF_FOUND
+#define CHALLENGE_MODES_WITH_SELF_FOUND 0
+#else
+#define CHALLENGE_MODES_WITH_SELF_FOUND 1
+#endif
+
+enum ChallengeModeSettings
+{
+    SETTING_HARDCORE           = 0,
+    SETTING_SEMI_HARDCORE      = 1,
+    SETTING_SELF_CRAFTED       = 2,
+    SETTING_ITEM_QUALITY_LEVEL = 3,
+    SETTING_SLOW_XP_GAIN       = 4,
+    SETTING_VERY_SLOW_XP_GAIN  = 5,
+    SETTING_QUEST_XP_ONLY      = 6,
+    SETTING_IRON_MAN           = 7,
+    SETTING_SELF_FOUND         = 8,
+    SETTING_MODE_MAX           = 9
+};
+
+// Indices of the "mod-challenge-modes" player settings that are not a challenge. Challenges added after these
+// flags are stored after them, see ChallengePlayerSettingIndex.
+enum ChallengeModePlayerSetting
+{
+    PLAYER_SETTING_MARK_DIRTY = 8,
+    PLAYER_SETTING_FALLEN     = 9,
+    PLAYER_SETTING_SELF_FOUND = 10,
+    PLAYER_SETTING_REVIVE     = 11  // Set by .challenge revive on offline characters, resurrects them at login
+};
+
+// Player setting index holding the given challenge
+constexpr uint8 ChallengePlayerSettingIndex(ChallengeModeSettings setting)
+{
+    return setting == SETTING_SELF_FOUND ? uint8(PLAYER_SETTING_SELF_FOUND) : uint8(setting);
+}
+
+enum ChallengeModeRuleFlags : uint32
+{
+    CHALLENGE_RULE_NONE              = 0x0000,
+    CHALLENGE_RULE_PERMADEATH        = 0x0001, // Resurrection is undone
+    CHALLENGE_RULE_LOSE_GEAR         = 0x0002, // Worn equipment and gold are lost on death
+    CHALLENGE_RULE_SELF_CRAFTED_GEAR = 0x0004, // Only self-crafted equipment can be worn
+    CHALLENGE_RULE_LOW_QUALITY_GEAR  = 0x0008, // Only Normal or Poor quality equipment can be worn
+    CHALLENGE_RULE_QUEST_XP_ONLY     = 0x0010, // No XP from kills
+    CHALLENGE_RULE_NO_TRADE          = 0x0020, // Cannot trade, in either direction
+    CHALLENGE_RULE_NO_MAIL           = 0x0040, // Cannot receive mail from other players
+    CHALLENGE_RULE_NO_AUCTION_HOUSE  = 0x0080,
+    CHALLENGE_RULE_NO_GUILD_BANK     = 0x0100,
+    CHALLENGE_RULE_NO_GROUP          = 0x0200,
+    CHALLENGE_RULE_NO_ENCHANTS       = 0x0400,
+    CHALLENGE_RULE_NO_TRADE_SKILLS   = 0x0800,
+    CHALLENGE_RULE_NO_CONSUMABLES    = 0x1000, // No potions, elixirs, flasks or buff food
+    CHALLENGE_RULE_NO_TALENTS        = 0x2000,
+    CHALLENGE_RULE_SELF_FOUND_GEAR   = 0x4000  // Only equipment the character looted, crafted, was rewarded or bought can be worn
+};
+
+constexpr uint32 ChallengeMask(ChallengeModeSettings setting) { return 1u << setting; }
+
+struct ChallengeModeDescriptor
+{
+    char const* name;              // Display name
+    char const* configPrefix;      // "<Challenge>" part of the config options
+    char const* gossipText;        // Shrine of Challenge option
+    float defaultXpMultiplier;
+    bool xpMultiplierConfigurable; // Whether <Challenge>.XPMultiplier is read
+    uint32 conflictMask;           // Challenges that cannot be active at the same time as this one
+    uint32 ruleFlags;              // ChallengeModeRuleFlags
+    bool compiled;                 // False when compiled out with CHALLENGE_MODES_DISABLE_<CHALLENGE>
+};
+
+// Indexed by ChallengeModeSettings
+inline constexpr std::array<ChallengeModeDescriptor, SETTING_MODE_MAX> ChallengeModeDescriptors =
+{{
+    { "Hardcore",          "Hardcore",         "Enable Hardcore Mode",          1.0f,  true,  ChallengeMask(SETTING_SEMI_HARDCORE),
+      CHALLENGE_RULE_PERMADEATH | CHALLENGE_RULE_NO_TRADE | CHALLENGE_RULE_NO_MAIL | CHALLENGE_RULE_NO_AUCTION_HOUSE | CHALLENGE_RULE_NO_GUILD_BANK,
+      CHALLENGE_MODES_WITH_HARDCORE },
+    { "Semi-Hardcore",     "SemiHardcore",     "Enable Semi-Hardcore Mode",     1.0f,  true,  ChallengeMask(SETTING_HARDCORE),
+      CHALLENGE_RULE_LOSE_GEAR,
+      CHALLENGE_MODES_WITH_SEMI_HARDCORE },
+    { "Self-Crafted",      "SelfCrafted",      "Enable Self-Crafted Mode",      1.0f,  true,  ChallengeMask(SETTING_IRON_MAN),
+      CHALLENGE_RULE_SELF_CRAFTED_GEAR | CHALLENGE_RULE_NO_TRADE | CHALLENGE_RULE_NO_MAIL | CHALLENGE_RULE_NO_AUCTION_HOUSE | CHALLENGE_RULE_NO_GUILD_BANK,
+      CHALLENGE_MODES_WITH_SELF_CRAFTED },
+    { "Low Quality Items", "ItemQualityLevel", "Enable Low Quality Item Mode",  1.0f,  true,  0,
+      CHALLENGE_RULE_LOW_QUALITY_GEAR,
+      CHALLENGE_MODES_WITH_ITEM_QUALITY_LEVEL },
+    { "Slow XP",           "SlowXpGain",       "Enable Slow XP Mode",           0.5f,  false, ChallengeMask(SETTING_VERY_SLOW_XP_GAIN),
+      CHALLENGE_RULE_NONE,
+      CHALLENGE_MODES_WITH_SLOW_XP_GAIN },
+    { "Very Slow XP",      "VerySlowXpGain",   "Enable Very Slow XP Mode",      0.25f, false, ChallengeMask(SETTING_SLOW_XP_GAIN),
+      CHALLENGE_RULE_NONE,
+      CHALLENGE_MODES_WITH_VERY_SLOW_XP_GAIN },
+    { "Quest XP Only",     "QuestXpOnly",      "Enable Quest XP Only Mode",     1.0f,  true,  0,
+      CHALLENGE_RULE_QUEST_XP_ONLY,
+      CHALLENGE_MODES_WITH_QUEST_XP_ONLY },
+    { "Iron Man",          "IronMan",          "Enable Iron Man Mode",          1.0f,  false, ChallengeMask(SETTING_SELF_CRAFTED),
+      CHALLENGE_RULE_PERMADEATH | CHALLENGE_RULE_LOW_QUALITY_GEAR | CHALLENGE_RULE_NO_GROUP | CHALLENGE_RULE_NO_ENCHANTS |
+      CHALLENGE_RULE_NO_TRADE_SKILLS | CHALLENGE_RULE_NO_CONSUMABLES | CHALLENGE_RULE_NO_TALENTS,
+      CHALLENGE_MODES_WITH_IRON_MAN },
+    { "Self-Found",        "SelfFound",        "Enable Self-Found Mode",        1.0f,  true,  0,
+      CHALLENGE_RULE_SELF_FOUND_GEAR | CHALLENGE_RULE_NO_TRADE | CHALLENGE_RULE_NO_MAIL | CHALLENGE_RULE_NO_AUCTION_HOUSE | CHALLENGE_RULE_NO_GUILD_BANK,
+      CHALLENGE_MODES_WITH_SELF_FOUND },
+}};
+
+// Mask of the challenges that prevent selecting the given one: itself and everything it conflicts with, in either direction
+constexpr uint32 ChallengeBlockMask(ChallengeModeSettings setting)
+{
+    uint32 mask = ChallengeMask(setting) | ChallengeModeDescriptors[setting].conflictMask;
+    for (uint8 i = 0; i < SETTING_MODE_MAX; ++i)
+    {
+        if (ChallengeModeDescriptors[i].conflictMask & ChallengeMask(setting))
+        {
+            mask |= ChallengeMask(ChallengeModeSettings(i));
+        }
+    }
+    return mask;
+}
+
+constexpr std::array<uint32, SETTING_MODE_MAX> BuildChallengeConflictMatrix()
+{
+    std::array<uint32, SETTING_MODE_MAX> matrix = {};
+    for (uint8 i = 0; i < SETTING_MODE_MAX; ++i)
+    {
+        matrix[i] = ChallengeBlockMask(ChallengeModeSettings(i));
+    }
+    return matrix;
+}
+
+// Indexed by ChallengeModeSettings, see ChallengeBlockMask
+inline constexpr std::array<uint32, SETTING_MODE_MAX> ChallengeConflictMatrix = BuildChallengeConflictMatrix();
+
+// Mask of the challenges that have any of the given ChallengeModeRuleFlags
+constexpr uint32 ChallengeRuleMask(uint32 ruleFlags)
+{
+    uint32 mask = 0;
+    for (uint8 i = 0; i < SETTING_MODE_MAX; ++i)
+    {
+        if (ChallengeModeDescriptors[i].ruleFlags & ruleFlags)
+        {
+            mask |= ChallengeMask(ChallengeModeSettings(i));
+        }
+    }
+    return mask;
+}
+
+// Rules that need to know how the items of the character were obtained
+constexpr uint32 CHALLENGE_PROVENANCE_RULES = CHALLENGE_RULE_SELF_CRAFTED_GEAR | CHALLENGE_RULE_SELF_FOUND_GEAR;
+
+// Number of distinct active challenge masks a player can have
+constexpr uint32 CHALLENGE_MASK_COUNT = 1u << SETTING_MODE_MAX;
+
+// Interactions restricted by the CHALLENGE_RULE_NO_* flags
+enum ChallengeInteraction
+{
+    CHALLENGE_INTERACTION_TRADE         = 0,
+    CHALLENGE_INTERACTION_MAIL          = 1,
+    CHALLENGE_INTERACTION_GROUP         = 2,
+    CHALLENGE_INTERACTION_AUCTION_HOUSE = 3,
+    CHALLENGE_INTERACTION_GUILD_BANK    = 4,
+    CHALLENGE_INTERACTION_MAX
+};
+
+struct ChallengeInteractionDescriptor
+{
+    char const* name;              // Used in <Challenge>.SameChallengeInteractions
+    uint32 ruleFlag;               // ChallengeModeRuleFlags that restricts the interaction
+    bool initiatorRestricted;      // The rule applies to the challenges of the player starting the interaction
+    bool targetRestricted;         // The rule applies to the challenges of the other player
+    char const* initiatorMessage;  // %s is the name of the blocking challenge
+    char const* targetMessage;
+};
+
+inline constexpr std::array<ChallengeInteractionDescriptor, CHALLENGE_INTERACTION_MAX> ChallengeInteractionDescriptors = {{
+    { "trade",        CHALLENGE_RULE_NO_TRADE,         true,  true,
+      "You cannot trade with other players while in %s mode.", "You cannot trade with players in %s mode." },
+    { "mail",         CHALLENGE_RULE_NO_MAIL,          false, true,
+      "", "You can't send mail to %s players." },
+    { "group",        CHALLENGE_RULE_NO_GROUP,         true,  true,
+      "You cannot group with other players while in %s mode.", "You cannot group with players in %s mode." },
+    { "auctionhouse", CHALLENGE_RULE_NO_AUCTION_HOUSE, true,  false,
+      "You cannot use the auction house in %s mode.", "" },
+    { "guildbank",    CHALLENGE_RULE_NO_GUILD_BANK,    true,  false,
+      "You cannot use the guild bank in %s mode.", "" },
+}};
+
+// Result of an interaction policy lookup: CHALLENGE_VERDICT_ALLOWED, or the blocking challenge + 1 with
+// CHALLENGE_VERDICT_TARGET set when the challenge belongs to the target.
+typedef uint8 ChallengeInteractionVerdict;
+constexpr ChallengeInteractionVerdict CHALLENGE_VERDICT_ALLOWED = 0;
+constexpr ChallengeInteractionVerdict CHALLENGE_VERDICT_TARGET  = 0x80;
+
+// Union of the ChallengeModeRuleFlags of the challenges in the mask
+constexpr uint32 ChallengeRuleFlags(uint32 challengeMask)
+{
+    uint32 ruleFlags = CHALLENGE_RULE_NONE;
+    for (uint8 i = 0; i < SETTING_MODE_MAX; ++i)
+    {
+        if (challengeMask & ChallengeMask(ChallengeModeSettings(i)))
+        {
+            ruleFlags |= ChallengeModeDescriptors[i].ruleFlags;
+        }
+    }
+    return ruleFlags;
+}
+
+// Version of the interaction rules below, part of the snapshot inputs hash. Bump it with every change to
+// ChallengeEvaluateInteraction or to the data it reads, so saved interaction policies are rebuilt.
+constexpr uint32 CHALLENGE_RULES_VERSION = 1;
+
+// Verdict of an interaction between two players with the given challenge masks. restrictedMask holds the enabled
+// challenges that forbid the interaction, exemptMask those of them that allow it between two of their players.
+constexpr ChallengeInteractionVerdict ChallengeEvaluateInteraction(ChallengeInteraction interaction, uint32 restrictedMask, uint32 exemptMask, uint32 initiatorMask, uint32 targetMask)
+{
+    ChallengeInteractionDescriptor const& desc = ChallengeInteractionDescriptors[interaction];
+    for (uint8 i = 0; i < SETTING_MODE_MAX; ++i)
+    {
+        uint32 mask = ChallengeMask(ChallengeModeSettings(i));
+        if (!(restrictedMask & mask))
+        {
+            continue;
+        }
+
+        // Same-challenge exceptions lift the restriction when both players have the challenge
+        if ((exemptMask & mask) && (initiatorMask & mask) && (targetMask & mask))
+        {
+            continue;
+        }
+
+        if (desc.initiatorRestricted && (initiatorMask & mask))
+        {
+            return i + 1;
+        }
+        if (desc.targetRestricted && (targetMask & mask))
+        {
+            return (i + 1) | CHALLENGE_VERDICT_TARGET;
+        }
+    }
+    return CHALLENGE_VERDICT_ALLOWED;
+}
+
+// Properties of the item, spell or XP source a rule is checked against. The hooks compute them from the item
+// template, the item and its provenance, see ChallengeModes::IsSelfCraftedItem and friends.
+enum ChallengeSubjectTraits : uint8
+{
+    CHALLENGE_TRAIT_NONE         = 0x00,
+    CHALLENGE_TRAIT_SELF_CRAFTED = 0x01,
+    CHALLENGE_TRAIT_SELF_FOUND   = 0x02,
+    CHALLENGE_TRAIT_LOW_QUALITY  = 0x04,
+    CHALLENGE_TRAIT_CONSUMABLE   = 0x08, // Potion, elixir, flask or buff food
+    CHALLENGE_TRAIT_TRADE_SKILL  = 0x10, // Trade skill spell other than the class professions
+    CHALLENGE_TRAIT_KILL         = 0x20  // XP for a kill rather than a quest or exploration
+};
+
+constexpr bool ChallengeRefusesEquip(uint32 ruleFlags, uint8 traits)
+{
+    return ((ruleFlags & CHALLENGE_RULE_SELF_CRAFTED_GEAR) && !(traits & CHALLENGE_TRAIT_SELF_CRAFTED)) ||
+           ((ruleFlags & CHALLENGE_RULE_SELF_FOUND_GEAR) && !(traits & CHALLENGE_TRAIT_SELF_FOUND)) ||
+           ((ruleFlags & CHALLENGE_RULE_LOW_QUALITY_GEAR) && !(traits & CHALLENGE_TRAIT_LOW_QUALITY));
+}
+
+constexpr bool ChallengeRefusesUse(uint32 ruleFlags, uint8 traits)
+{
+    return (ruleFlags & CHALLENGE_RULE_NO_CONSUMABLES) && (traits & CHALLENGE_TRAIT_CONSUMABLE);
+}
+
+constexpr bool ChallengeRefusesSpell(uint32 ruleFlags, uint8 traits)
+{
+    return (ruleFlags & CHALLENGE_RULE_NO_TRADE_SKILLS) && (traits & CHALLENGE_TRAIT_TRADE_SKILL);
+}
+
+// Multiplier of one challenge in ChallengeAdjustXp, 0 for the XP it forbids
+inline float ChallengeXpStepMultiplier(ChallengeModeSettings setting, std::array<float, SETTING_MODE_MAX> const& xpMultipliers, bool kill)
+{
+    return (kill && (ChallengeModeDescriptors[setting].ruleFlags & CHALLENGE_RULE_QUEST_XP_ONLY)) ? 0.0f : xpMultipliers[setting];
+}
+
+// XP granted after the adjustments of the challenges in the mask, applied in challenge order
+inline uint32 ChallengeAdjustXp(uint32 challengeMask, std::array<float, SETTING_MODE_MAX> const& xpMultipliers, uint32 amount, uint8 traits)
+{
+    for (uint8 i = 0; i < SETTING_MODE_MAX; ++i)
+    {
+        auto setting = ChallengeModeSettings(i);
+        if (challengeMask & ChallengeMask(setting))
+        {
+            amount *= ChallengeXpStepMultiplier(setting, xpMultipliers, traits & CHALLENGE_TRAIT_KILL);
+        }
+    }
+    return amount;
+}
+
+// ChallengeAdjustXp for the recipients of a group or raid kill, challengeMasks and amounts indexed by recipient
+inline void ChallengeAdjustXpBatch(uint32 const* challengeMasks, uint32* amounts, size_t count, std::array<float, SETTING_MODE_MAX> const& xpMultipliers, uint8 traits)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (challengeMasks[i])
+        {
+            amounts[i] = ChallengeAdjustXp(challengeMasks[i], xpMultipliers, amounts[i], traits);
+        }
+    }
+}
+
+#endif //AZEROTHCORE_CHALLENGEMODESRULES_H
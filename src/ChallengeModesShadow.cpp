@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2016+ AzerothCore <www.azerothcore.org>, released under GNU AGPL v3 license: https://github.com/azerothcore/azerothcore-wotlk/blob/master/LICENSE-AGPL3
+ */
+
+#include "ChallengeModesShadow.h"
+
+ChallengeModesShadow* ChallengeModesShadow::instance()
+{
+    static ChallengeModesShadow instance;
+    return &instance;
+}
+
+ChallengeModesShadow::Shard& ChallengeModesShadow::GetShard()
+{
+    thread_local Shard* shard = nullptr;
+    if (!shard)
+    {
+        std::lock_guard<std::mutex> guard(_shardLock);
+        _shards.push_back(std::make_unique<Shard>());
+        shard = _shards.back().get();
+    }
+    return *shard;
+}
+
+void ChallengeModesShadow::Record(ChallengeModeSettings setting, ChallengeShadowHook hook, Player* player, bool rejected, uint64 elapsed)
+{
+    Shard& shard = GetShard();
+    ShardCounters& counters = shard.counters[setting][hook];
+    Add(counters.evaluations, 1);
+    Add(counters.time, elapsed);
+
+    if (!rejected)
+    {
+        return;
+    }
+
+    Add(counters.rejections, 1);
+
+    std::lock_guard<std::mutex> guard(shard.affectedLock);
+    shard.affectedPlayers[setting].insert(player->GetGUID().GetCounter());
+}
+
+ChallengeShadowCounters ChallengeModesShadow::Sum(ChallengeModeSettings setting, ChallengeShadowHook hook) const
+{
+    ChallengeShadowCounters total;
+    for (std::unique_ptr<Shard> const& shard : _shards)
+    {
+        ShardCounters const& counters = shard->counters[setting][hook];
+        total.evaluations += counters.evaluations.load(std::memory_order_relaxed);
+        total.rejections += counters.rejections.load(std::memory_order_relaxed);
+        total.time += counters.time.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+ChallengeShadowCounters ChallengeModesShadow::GetCounters(ChallengeModeSettings setting, ChallengeShadowHook hook)
+{
+    std::lock_guard<std::mutex> guard(_shardLock);
+    ChallengeShadowCounters total = Sum(setting, hook);
+    ChallengeShadowCounters const& reset = _resetTotals[setting][hook];
+    total.evaluations -= reset.evaluations;
+    total.rejections -= reset.rejections;
+    total.time -= reset.time;
+    return total;
+}
+
+uint32 ChallengeModesShadow::GetAffectedPlayerCount(ChallengeModeSettings setting)
+{
+    std::unordered_set<ObjectGuid::LowType> affected;
+    std::lock_guard<std::mutex> guard(_shardLock);
+    for (std::unique_ptr<Shard> const& shard : _shards)
+    {
+        std::lock_guard<std::mutex> shardGuard(shard->affectedLock);
+        affected.insert(shard->affectedPlayers[setting].begin(), shard->affectedPlayers[setting].end());
+    }
+    return affected.size();
+}
+
+void ChallengeModesShadow::Reset()
+{
+    // The shards are only written by their thread, so the counters are reset by remembering the current totals
+    std::lock_guard<std::mutex> guard(_shardLock);
+    for (uint8 i = 0; i < SETTING_MODE_MAX; ++i)
+    {
+        for (uint8 hook = 0; hook < SHADOW_HOOK_MAX; ++hook)
+        {
+            _resetTotals[i][hook] = Sum(ChallengeModeSettings(i), ChallengeShadowHook(hook));
+        }
+    }
+
+    for (std::unique_ptr<Shard> const& shard : _shards)
+    {
+        std::lock_guard<std::mutex> shardGuard(shard->affectedLock);
+        for (auto& players : shard->affectedPlayers)
+        {
+            players.clear();
+        }
+    }
+}
+
+char const* ChallengeModesShadow::GetHookName(ChallengeShadowHook hook)
+{
+    switch (hook)
+    {
+        case SHADOW_HOOK_EQUIP_ITEM:
+            return "equip item";
+        case SHADOW_HOOK_USE_ITEM:
+            return "use item";
+        case SHADOW_HOOK_LEARN_SPELL:
+            return "learn spell";
+        case SHADOW_HOOK_GROUP:
+            return "group";
+        case SHADOW_HOOK_TRADE:
+            return "trade";
+        case SHADOW_HOOK_MAIL:
+            return "mail";
+        case SHADOW_HOOK_AUCTION_HOUSE:
+            return "auction house";
+        case SHADOW_HOOK_GUILD_BANK:
+            return "guild bank";
+        default:
+            return "unknown";
+    }
+}
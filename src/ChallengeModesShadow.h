@@ -0,0 +1,97 @@
+#ifndef AZEROTHCORE_CHALLENGEMODESSHADOW_H
+#define AZEROTHCORE_CHALLENGEMODESSHADOW_H
+
+#include "ChallengeModes.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+
+enum ChallengeShadowHook
+{
+    SHADOW_HOOK_EQUIP_ITEM    = 0,
+    SHADOW_HOOK_USE_ITEM      = 1,
+    SHADOW_HOOK_LEARN_SPELL   = 2,
+    SHADOW_HOOK_GROUP         = 3,
+    SHADOW_HOOK_TRADE         = 4,
+    SHADOW_HOOK_MAIL          = 5,
+    SHADOW_HOOK_AUCTION_HOUSE = 6,
+    SHADOW_HOOK_GUILD_BANK    = 7,
+    SHADOW_HOOK_MAX
+};
+
+struct ChallengeShadowCounters
+{
+    uint64 evaluations = 0;
+    uint64 rejections = 0;
+    uint64 time = 0; // Nanoseconds spent evaluating the rule
+};
+
+/*
+ * Shadow evaluation of challenges (<Challenge>.Shadow = 1). For every player on whom the challenge is not
+ * enforced, the hooks evaluate its rule as if it were, and record the would-be rejections and the evaluation time.
+ * Nothing is blocked and no message is sent. Interactions are evaluated through the interaction rules as if the
+ * initiating player had the challenge, so same-challenge exceptions are taken into account. Every thread that runs
+ * a hook records to its own shard, the command merges the shards.
+ */
+class ChallengeModesShadow
+{
+public:
+    static ChallengeModesShadow* instance();
+
+    uint32 shadowMask = 0; // Challenges in shadow mode, 0 when the module is disabled
+
+    [[nodiscard]] bool IsShadowed(ChallengeModeSettings setting) const { return shadowMask & ChallengeMask(setting); }
+
+    // rejects returns true when the rule would have blocked the action
+    template<class Rule>
+    void Evaluate(ChallengeModeSettings setting, ChallengeShadowHook hook, Player* player, Rule&& rejects)
+    {
+        auto const start = std::chrono::steady_clock::now();
+        bool const rejected = rejects();
+        uint64 const elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        Record(setting, hook, player, rejected, elapsed);
+    }
+
+    // Totals since the last reset, merged over all shards
+    [[nodiscard]] ChallengeShadowCounters GetCounters(ChallengeModeSettings setting, ChallengeShadowHook hook);
+    [[nodiscard]] uint32 GetAffectedPlayerCount(ChallengeModeSettings setting);
+    void Reset();
+
+    static char const* GetHookName(ChallengeShadowHook hook);
+
+private:
+    struct ShardCounters
+    {
+        std::atomic<uint64> evaluations{0};
+        std::atomic<uint64> rejections{0};
+        std::atomic<uint64> time{0};
+    };
+
+    struct Shard
+    {
+        std::array<std::array<ShardCounters, SHADOW_HOOK_MAX>, SETTING_MODE_MAX> counters;
+        std::mutex affectedLock; // Only contended while the command merges the shard
+        std::array<std::unordered_set<ObjectGuid::LowType>, SETTING_MODE_MAX> affectedPlayers; // Players with at least one would-be rejection
+    };
+
+    // Only the owning thread writes a shard, so a relaxed load and store is enough and avoids a locked instruction
+    static void Add(std::atomic<uint64>& slot, uint64 value)
+    {
+        slot.store(slot.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    Shard& GetShard();
+    void Record(ChallengeModeSettings setting, ChallengeShadowHook hook, Player* player, bool rejected, uint64 elapsed);
+    ChallengeShadowCounters Sum(ChallengeModeSettings setting, ChallengeShadowHook hook) const;
+
+    std::mutex _shardLock;
+    std::vector<std::unique_ptr<Shard>> _shards; // Never shrinks, shards of finished threads keep their totals
+    std::array<std::array<ChallengeShadowCounters, SHADOW_HOOK_MAX>, SETTING_MODE_MAX> _resetTotals = {}; // Totals at the last reset
+};
+
+#define sChallengeModesShadow ChallengeModesShadow::instance()
+
+#endif //AZEROTHCORE_CHALLENGEMODESSHADOW_H
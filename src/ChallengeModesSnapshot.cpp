@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2016+ AzerothCore <www.azerothcore.org>, released under GNU AGPL v3 license: https://github.com/azerothcore/azerothcore-wotlk/blob/master/LICENSE-AGPL3
+ */
+
+#include "ChallengeModesSnapshot.h"
+#include "GitRevision.h"
+#include <cstdio>
+#include <cstring>
+
+ChallengeModesSnapshot* ChallengeModesSnapshot::instance()
+{
+    static ChallengeModesSnapshot instance;
+    return &instance;
+}
+
+uint64 ChallengeModesSnapshot::Hash(void const* data, size_t size, uint64 hash)
+{
+    // FNV-1a
+    auto bytes = static_cast<uint8 const*>(data);
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+uint64 ChallengeModesSnapshot::GetInputsHash(std::array<uint32, CHALLENGE_INTERACTION_MAX> const& restrictedMasks, std::array<uint32, CHALLENGE_INTERACTION_MAX> const& exemptMasks)
+{
+    char const* build = GitRevision::GetHash();
+    uint32 const rulesVersion = CHALLENGE_RULES_VERSION;
+    uint64 hash = Hash(build, std::strlen(build));
+    hash = Hash(&rulesVersion, sizeof(rulesVersion), hash);
+    hash = Hash(restrictedMasks.data(), sizeof(restrictedMasks), hash);
+    return Hash(exemptMasks.data(), sizeof(exemptMasks), hash);
+}
+
+bool ChallengeModesSnapshot::LoadInteractionPolicy(uint64 inputsHash)
+{
+    _stale = false;
+    if (!snapshotEnabled)
+    {
+        return false;
+    }
+
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file)
+    {
+        return false;
+    }
+
+    auto& policy = sChallengeModes->interactionPolicy;
+    ChallengeSnapshotHeader header;
+    bool valid = std::fread(&header, sizeof(header), 1, file) == 1 &&
+        header.magic == CHALLENGE_SNAPSHOT_MAGIC && header.version == CHALLENGE_SNAPSHOT_VERSION &&
+        header.challengeCount == SETTING_MODE_MAX && header.interactionCount == CHALLENGE_INTERACTION_MAX &&
+        header.payloadSize == sizeof(policy) && header.inputsHash == inputsHash;
+    // The policy is only overwritten once the header matches, and rebuilt by the caller if the payload is corrupt
+    valid = valid && std::fread(policy.data(), sizeof(policy), 1, file) == 1 && std::fgetc(file) == EOF &&
+        Hash(policy.data(), sizeof(policy)) == header.checksum;
+    std::fclose(file);
+
+    if (!valid)
+    {
+        LOG_INFO("module", "Challenge Modes: snapshot {} is outdated or invalid, it is rebuilt.", path);
+    }
+    return valid;
+}
+
+void ChallengeModesSnapshot::MarkStale(uint64 inputsHash)
+{
+    _stale = true;
+    _inputsHash = inputsHash;
+}
+
+void ChallengeModesSnapshot::Save()
+{
+    if (!snapshotEnabled || !_stale || !sChallengeModes->enabled())
+    {
+        return;
+    }
+
+    auto const& policy = sChallengeModes->interactionPolicy;
+    ChallengeSnapshotHeader header;
+    header.magic = CHALLENGE_SNAPSHOT_MAGIC;
+    header.version = CHALLENGE_SNAPSHOT_VERSION;
+    header.challengeCount = SETTING_MODE_MAX;
+    header.interactionCount = CHALLENGE_INTERACTION_MAX;
+    header.inputsHash = _inputsHash;
+    header.payloadSize = sizeof(policy);
+    header.checksum = Hash(policy.data(), sizeof(policy));
+
+    // Written aside and renamed, so a crash while writing never leaves a truncated snapshot behind
+    std::string tempPath = path + ".tmp";
+    std::FILE* file = std::fopen(tempPath.c_str(), "wb");
+    if (!file)
+    {
+        LOG_ERROR("mod-challenge-modes", "Cannot write the snapshot {}, the next start rebuilds the module caches.", tempPath);
+        return;
+    }
+
+    bool written = std::fwrite(&header, sizeof(header), 1, file) == 1 && std::fwrite(policy.data(), sizeof(policy), 1, file) == 1;
+    written = std::fclose(file) == 0 && written;
+    std::remove(path.c_str());
+    if (!written || std::rename(tempPath.c_str(), path.c_str()) != 0)
+    {
+        LOG_ERROR("mod-challenge-modes", "Cannot write the snapshot {}, the next start rebuilds the module caches.", path);
+        std::remove(tempPath.c_str());
+        return;
+    }
+
+    _stale = false;
+    LOG_INFO("module", "Challenge Modes: snapshot written to {}.", path);
+}
@@ -0,0 +1,51 @@
+#ifndef AZEROTHCORE_CHALLENGEMODESSNAPSHOT_H
+#define AZEROTHCORE_CHALLENGEMODESSNAPSHOT_H
+
+#include "ChallengeModes.h"
+
+constexpr uint32 CHALLENGE_SNAPSHOT_MAGIC   = 0x4E534D43; // "CMSN"
+constexpr uint32 CHALLENGE_SNAPSHOT_VERSION = 3;
+
+struct ChallengeSnapshotHeader
+{
+    uint32 magic;
+    uint32 version;
+    uint32 challengeCount;
+    uint32 interactionCount;
+    uint64 inputsHash; // Hash of the build, the rules version and the config the payload was computed from
+    uint64 payloadSize;
+    uint64 checksum;   // FNV-1a of the payload
+};
+
+/*
+ * Warm-start snapshot of the interaction policy, the only module cache whose rebuild is noticeable at startup
+ * (CHALLENGE_INTERACTION_MAX * CHALLENGE_MASK_COUNT^2 rule evaluations). The snapshot is written at shutdown after
+ * a rebuild and used on the next start when it was computed by the same revision and rules version from the same
+ * config. The payload is checksummed, a snapshot that does not match is rebuilt instead of becoming the policy.
+ */
+class ChallengeModesSnapshot
+{
+public:
+    static ChallengeModesSnapshot* instance();
+
+    bool snapshotEnabled = true;
+    std::string path;
+
+    // Hash of everything the interaction policy depends on, restrictedMasks and exemptMasks indexed by interaction
+    [[nodiscard]] static uint64 GetInputsHash(std::array<uint32, CHALLENGE_INTERACTION_MAX> const& restrictedMasks, std::array<uint32, CHALLENGE_INTERACTION_MAX> const& exemptMasks);
+    // Fills the interaction policy from the snapshot, returns false when it is missing, invalid or for other inputs
+    bool LoadInteractionPolicy(uint64 inputsHash);
+    // Called after the interaction policy was rebuilt, so the snapshot is rewritten at shutdown
+    void MarkStale(uint64 inputsHash);
+    void Save();
+
+private:
+    [[nodiscard]] static uint64 Hash(void const* data, size_t size, uint64 hash = 0xCBF29CE484222325ULL);
+
+    bool _stale = false;
+    uint64 _inputsHash = 0;
+};
+
+#define sChallengeModesSnapshot ChallengeModesSnapshot::instance()
+
+#endif //AZEROTHCORE_CHALLENGEMODESSNAPSHOT_H
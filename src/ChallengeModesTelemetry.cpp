@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2016+ AzerothCore <www.azerothcore.org>, released under GNU AGPL v3 license: https://github.com/azerothcore/azerothcore-wotlk/blob/master/LICENSE-AGPL3
+ */
+
+#include "ChallengeModesTelemetry.h"
+
+ChallengeModesTelemetry* ChallengeModesTelemetry::instance()
+{
+    static ChallengeModesTelemetry instance;
+    return &instance;
+}
+
+ChallengeModesTelemetry::Shard& ChallengeModesTelemetry::GetShard()
+{
+    thread_local Shard* shard = nullptr;
+    if (!shard)
+    {
+        std::lock_guard<std::mutex> guard(_shardLock);
+        _shards.push_back(std::make_unique<Shard>());
+        shard = _shards.back().get();
+    }
+    return *shard;
+}
+
+void ChallengeModesTelemetry::RegisterEventHandlers()
+{
+    sChallengeModes->RegisterEventHandler(CHALLENGE_EVENT_DEATH, [this](Player* player, uint32 challengeMask)
+    {
+        if (!telemetryEnabled)
+        {
+            return;
+        }
+
+        Shard& shard = GetShard();
+        for (uint8 i = 0; i < SETTING_MODE_MAX; ++i)
+        {
+            if (challengeMask & ChallengeMask(ChallengeModeSettings(i)))
+            {
+                Add(shard, ChallengeModeSettings(i), player->GetLevel(), TELEMETRY_DEATHS, 1);
+            }
+        }
+    });
+}
+
+void ChallengeModesTelemetry::Update(uint32 diff)
+{
+    if (!telemetryEnabled)
+    {
+        return;
+    }
+
+    if (_timer > diff)
+    {
+        _timer -= diff;
+        return;
+    }
+    _timer = _interval;
+
+    Flush();
+}
+
+void ChallengeModesTelemetry::Flush()
+{
+    ChallengeTelemetryTotals totals = {};
+    {
+        std::lock_guard<std::mutex> guard(_shardLock);
+        for (std::unique_ptr<Shard> const& shard : _shards)
+        {
+            for (uint8 i = 0; i < SETTING_MODE_MAX; ++i)
+            {
+                for (uint8 level = 0; level < CHALLENGE_TELEMETRY_LEVELS; ++level)
+                {
+                    for (uint8 counter = 0; counter < TELEMETRY_COUNTER_MAX; ++counter)
+                    {
+                        totals[i][level][counter] += shard->counters[i][level][counter].load(std::memory_order_relaxed);
+                    }
+                }
+            }
+        }
+    }
+
+    CharacterDatabaseTransaction trans = CharacterDatabase.BeginTransaction();
+    uint32 rows = 0;
+    for (uint8 i = 0; i < SETTING_MODE_MAX; ++i)
+    {
+        for (uint8 level = 0; level < CHALLENGE_TELEMETRY_LEVELS; ++level)
+        {
+            std::array<uint64, TELEMETRY_COUNTER_MAX> delta;
+            bool changed = false;
+            for (uint8 counter = 0; counter < TELEMETRY_COUNTER_MAX; ++counter)
+            {
+                delta[counter] = totals[i][level][counter] - _flushed[i][level][counter];
+                changed |= delta[counter] != 0;
+            }
+
+            if (!changed)
+            {
+                continue;
+            }
+
+            trans->Append("INSERT INTO challenge_modes_telemetry (challenge, level, xp_events, xp_base, xp_granted, level_ups, level_time, deaths) "
+                "VALUES ({}, {}, {}, {}, {}, {}, {}, {}) ON DUPLICATE KEY UPDATE xp_events = xp_events + VALUES(xp_events), "
+                "xp_base = xp_base + VALUES(xp_base), xp_granted = xp_granted + VALUES(xp_granted), level_ups = level_ups + VALUES(level_ups), "
+                "level_time = level_time + VALUES(level_time), deaths = deaths + VALUES(deaths)",
+                i, level, delta[TELEMETRY_XP_EVENTS], delta[TELEMETRY_XP_BASE], delta[TELEMETRY_XP_GRANTED],
+                delta[TELEMETRY_LEVEL_UPS], delta[TELEMETRY_LEVEL_TIME], delta[TELEMETRY_DEATHS]);
+            ++rows;
+        }
+    }
+
+    if (rows)
+    {
+        CharacterDatabase.CommitTransaction(trans);
+    }
+    _flushed = totals;
+}
@@ -0,0 +1,95 @@
+#ifndef AZEROTHCORE_CHALLENGEMODESTELEMETRY_H
+#define AZEROTHCORE_CHALLENGEMODESTELEMETRY_H
+
+#include "ChallengeModes.h"
+#include <atomic>
+#include <memory>
+
+// Histogram buckets are levels 0 to DEFAULT_MAX_LEVEL
+constexpr uint32 CHALLENGE_TELEMETRY_LEVELS = DEFAULT_MAX_LEVEL + 1;
+
+enum ChallengeTelemetryCounter
+{
+    TELEMETRY_XP_EVENTS  = 0,
+    TELEMETRY_XP_BASE    = 1, // XP before the adjustment of the challenge
+    TELEMETRY_XP_GRANTED = 2, // XP after the adjustment of the challenge
+    TELEMETRY_LEVEL_UPS  = 3, // Level ups from the bucket level
+    TELEMETRY_LEVEL_TIME = 4, // Played time spent at the bucket level before leveling up, in seconds
+    TELEMETRY_DEATHS     = 5,
+    TELEMETRY_COUNTER_MAX
+};
+
+typedef std::array<std::array<std::array<uint64, TELEMETRY_COUNTER_MAX>, CHALLENGE_TELEMETRY_LEVELS>, SETTING_MODE_MAX> ChallengeTelemetryTotals;
+
+/*
+ * XP and progression histograms per challenge and level, used to balance the XP multipliers. Every thread that
+ * runs a hook writes to its own shard, so recording is a few uncontended relaxed increments. The world thread
+ * merges the shards on a long interval and adds the difference to the challenge_modes_telemetry table.
+ */
+class ChallengeModesTelemetry
+{
+public:
+    static ChallengeModesTelemetry* instance();
+
+    bool telemetryEnabled = false;
+
+    // Set by the config, the next flush is one interval after the call
+    void SetInterval(uint32 interval)
+    {
+        _interval = interval;
+        _timer = interval;
+    }
+
+    void RecordXp(ChallengeModeSettings setting, uint8 level, uint32 baseAmount, uint32 grantedAmount)
+    {
+        if (!telemetryEnabled)
+        {
+            return;
+        }
+        Shard& shard = GetShard();
+        Add(shard, setting, level, TELEMETRY_XP_EVENTS, 1);
+        Add(shard, setting, level, TELEMETRY_XP_BASE, baseAmount);
+        Add(shard, setting, level, TELEMETRY_XP_GRANTED, grantedAmount);
+    }
+    void RecordLevelUp(ChallengeModeSettings setting, uint8 oldLevel, uint32 levelTime)
+    {
+        if (!telemetryEnabled)
+        {
+            return;
+        }
+        Shard& shard = GetShard();
+        Add(shard, setting, oldLevel, TELEMETRY_LEVEL_UPS, 1);
+        Add(shard, setting, oldLevel, TELEMETRY_LEVEL_TIME, levelTime);
+    }
+
+    // Subscribes to the death event, must be called while the scripts are loaded
+    void RegisterEventHandlers();
+    void Update(uint32 diff);
+    // Writes everything recorded since the last flush
+    void Flush();
+
+private:
+    struct Shard
+    {
+        std::array<std::array<std::array<std::atomic<uint64>, TELEMETRY_COUNTER_MAX>, CHALLENGE_TELEMETRY_LEVELS>, SETTING_MODE_MAX> counters = {};
+    };
+
+    // Only the owning thread writes a shard, so a relaxed load and store is enough and avoids a locked instruction
+    static void Add(Shard& shard, ChallengeModeSettings setting, uint8 level, ChallengeTelemetryCounter counter, uint64 value)
+    {
+        std::atomic<uint64>& slot = shard.counters[setting][std::min<uint32>(level, DEFAULT_MAX_LEVEL)][counter];
+        slot.store(slot.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    Shard& GetShard();
+
+    std::mutex _shardLock;
+    std::vector<std::unique_ptr<Shard>> _shards; // Never shrinks, shards of finished threads keep their totals
+    ChallengeTelemetryTotals _flushed = {};      // Totals already written to the DB
+    uint32 _interval = HOUR * IN_MILLISECONDS;
+    uint32 _timer = HOUR * IN_MILLISECONDS;
+};
+
+#define sChallengeModesTelemetry ChallengeModesTelemetry::instance()
+
+#endif //AZEROTHCORE_CHALLENGEMODESTELEMETRY_H
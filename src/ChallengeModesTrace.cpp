@@ -0,0 +1,245 @@
+/*
+ * Copyright (C) 2016+ AzerothCore <www.azerothcore.org>, released under GNU AGPL v3 license: https://github.com/azerothcore/azerothcore-wotlk/blob/master/LICENSE-AGPL3
+ */
+
+#include "ChallengeModesTrace.h"
+#include "GameTime.h"
+#include <thread>
+
+ChallengeModesTrace* ChallengeModesTrace::instance()
+{
+    static ChallengeModesTrace instance;
+    return &instance;
+}
+
+void ChallengeModesTrace::Restart(bool enable, std::string const& path)
+{
+    Stop();
+    if (!enable)
+    {
+        return;
+    }
+
+    _file = std::fopen(path.c_str(), "wb");
+    if (!_file)
+    {
+        LOG_ERROR("mod-challenge-modes", "Cannot open the hook trace file {}, hooks are not traced.", path);
+        return;
+    }
+    _path = path;
+
+    ChallengeTraceFileHeader header = {};
+    header.magic = CHALLENGE_TRACE_MAGIC;
+    header.version = CHALLENGE_TRACE_VERSION;
+    header.recordSize = sizeof(ChallengeTraceRecord);
+    header.challengeCount = SETTING_MODE_MAX;
+    header.enabledMask = sChallengeModes->enabledChallengeMask;
+    header.startTime = GameTime::GetGameTime().count();
+    for (uint8 i = 0; i < SETTING_MODE_MAX; ++i)
+    {
+        header.xpMultipliers[i] = sChallengeModes->getXpBonusForChallenge(ChallengeModeSettings(i));
+    }
+    for (uint8 interaction = 0; interaction < CHALLENGE_INTERACTION_MAX; ++interaction)
+    {
+        header.exemptMasks[interaction] = sChallengeModes->GetSameChallengeExemptMask(ChallengeInteraction(interaction));
+    }
+    std::fwrite(&header, sizeof(header), 1, _file);
+
+    // Records of a previous trace that were not flushed belong to the old config. Stop quiesced the producers
+    // and they cannot pass the traceEnabled check in Push until it is stored below, so the tails are not raced.
+    {
+        std::lock_guard<std::mutex> guard(_bufferLock);
+        for (std::unique_ptr<Buffer> const& buffer : _buffers)
+        {
+            buffer->tail.store(buffer->head.load(std::memory_order_acquire), std::memory_order_release);
+        }
+    }
+
+    _startTime = std::chrono::steady_clock::now();
+    _written = 0;
+    _timer = IN_MILLISECONDS;
+    traceEnabled.store(true, std::memory_order_release);
+    LOG_INFO("module", "Challenge Modes: tracing hooks to {}.", path);
+}
+
+void ChallengeModesTrace::Stop()
+{
+    if (!_file)
+    {
+        return;
+    }
+
+    traceEnabled.store(false, std::memory_order_seq_cst);
+    Quiesce();
+    Flush();
+    std::fclose(_file);
+    _file = nullptr;
+    LOG_INFO("module", "Challenge Modes: hook trace {} closed, {} records written.", _path, _written);
+}
+
+void ChallengeModesTrace::Update(uint32 diff)
+{
+    if (!traceEnabled.load(std::memory_order_acquire))
+    {
+        return;
+    }
+
+    if (_timer > diff)
+    {
+        _timer -= diff;
+        return;
+    }
+    _timer = IN_MILLISECONDS;
+
+    Flush();
+}
+
+void ChallengeModesTrace::Flush()
+{
+    std::lock_guard<std::mutex> guard(_bufferLock);
+    for (std::unique_ptr<Buffer> const& buffer : _buffers)
+    {
+        uint64 tail = buffer->tail.load(std::memory_order_relaxed);
+        uint64 head = buffer->head.load(std::memory_order_acquire);
+        if (head == tail)
+        {
+            continue;
+        }
+
+        // The pending records may wrap around the end of the buffer, so they are written in up to two parts
+        uint32 start = tail & (buffer->capacity - 1);
+        uint64 count = head - tail;
+        uint64 firstPart = std::min<uint64>(count, buffer->capacity - start);
+        std::fwrite(&buffer->records[start], sizeof(ChallengeTraceRecord), firstPart, _file);
+        std::fwrite(&buffer->records[0], sizeof(ChallengeTraceRecord), count - firstPart, _file);
+
+        buffer->tail.store(head, std::memory_order_release);
+        _written += count;
+    }
+    std::fflush(_file);
+}
+
+void ChallengeModesTrace::Quiesce()
+{
+    std::lock_guard<std::mutex> guard(_bufferLock);
+    for (std::unique_ptr<Buffer> const& buffer : _buffers)
+    {
+        while (buffer->pushing.load(std::memory_order_seq_cst))
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+ChallengeModesTrace::Buffer& ChallengeModesTrace::GetBuffer()
+{
+    thread_local Buffer* buffer = nullptr;
+    if (!buffer)
+    {
+        uint32 capacity = 1024;
+        while (capacity < bufferSize)
+        {
+            capacity <<= 1;
+        }
+
+        std::lock_guard<std::mutex> guard(_bufferLock);
+        _buffers.push_back(std::make_unique<Buffer>(capacity));
+        buffer = _buffers.back().get();
+    }
+    return *buffer;
+}
+
+void ChallengeModesTrace::Push(Player* player, ChallengeTraceHook hook, uint32 challengeMask, uint32 subject, uint32 amount, uint32 result, uint8 traits)
+{
+    Buffer& buffer = GetBuffer();
+
+    // The hook checked traceEnabled without announcing itself, so the check is repeated once pushing is set: either
+    // Stop sees pushing and waits for this record, or this sees traceEnabled cleared and the record is not written
+    buffer.pushing.store(true, std::memory_order_seq_cst);
+    if (!traceEnabled.load(std::memory_order_seq_cst))
+    {
+        buffer.pushing.store(false, std::memory_order_release);
+        return;
+    }
+
+    uint64 head = buffer.head.load(std::memory_order_relaxed);
+    if (head - buffer.tail.load(std::memory_order_acquire) >= buffer.capacity)
+    {
+        buffer.dropped.store(buffer.dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        buffer.pushing.store(false, std::memory_order_release);
+        return;
+    }
+
+    ChallengeTraceRecord& record = buffer.records[head & (buffer.capacity - 1)];
+    record.time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _startTime).count();
+    record.playerGuid = player->GetGUID().GetCounter();
+    record.subject = subject;
+    record.amount = amount;
+    record.result = result;
+    record.challengeMask = challengeMask;
+    record.hook = hook;
+    record.traits = traits;
+    record.level = player->GetLevel();
+    record.padding[0] = record.padding[1] = record.padding[2] = 0;
+
+    buffer.head.store(head + 1, std::memory_order_release);
+    buffer.pushing.store(false, std::memory_order_release);
+}
+
+void ChallengeModesTrace::RecordXp(Player* player, uint32 grantedAmount, bool kill)
+{
+    Push(player, TRACE_HOOK_GIVE_XP, sChallengeModes->GetEnforcedChallengeMask(player), 0, PendingXp(), grantedAmount, kill ? CHALLENGE_TRAIT_KILL : CHALLENGE_TRAIT_NONE);
+}
+
+void ChallengeModesTrace::RecordEquip(Player* player, Item* item)
+{
+    uint8 traits = CHALLENGE_TRAIT_NONE;
+    if (ChallengeModes::IsSelfCraftedItem(player, item))
+    {
+        traits |= CHALLENGE_TRAIT_SELF_CRAFTED;
+    }
+    if (ChallengeModes::IsSelfFoundItem(player, item))
+    {
+        traits |= CHALLENGE_TRAIT_SELF_FOUND;
+    }
+    if (ChallengeModes::IsLowQualityItem(item->GetTemplate()))
+    {
+        traits |= CHALLENGE_TRAIT_LOW_QUALITY;
+    }
+
+    uint32 challengeMask = sChallengeModes->GetRestrictedChallengeMask(player);
+    Push(player, TRACE_HOOK_EQUIP_ITEM, challengeMask, item->GetEntry(), 0, ChallengeRefusesEquip(ChallengeRuleFlags(challengeMask), traits), traits);
+}
+
+void ChallengeModesTrace::RecordUse(Player* player, ItemTemplate const* proto)
+{
+    uint8 traits = ChallengeModes::IsForbiddenConsumable(proto) ? CHALLENGE_TRAIT_CONSUMABLE : CHALLENGE_TRAIT_NONE;
+    uint32 challengeMask = sChallengeModes->GetRestrictedChallengeMask(player);
+    Push(player, TRACE_HOOK_USE_ITEM, challengeMask, proto->ItemId, 0, ChallengeRefusesUse(ChallengeRuleFlags(challengeMask), traits), traits);
+}
+
+void ChallengeModesTrace::RecordSpell(Player* player, uint32 spellId)
+{
+    uint8 traits = ChallengeModes::IsForbiddenTradeSkill(spellId) ? CHALLENGE_TRAIT_TRADE_SKILL : CHALLENGE_TRAIT_NONE;
+    uint32 challengeMask = sChallengeModes->GetRestrictedChallengeMask(player);
+    Push(player, TRACE_HOOK_LEARN_SPELL, challengeMask, spellId, 0, ChallengeRefusesSpell(ChallengeRuleFlags(challengeMask), traits), traits);
+}
+
+void ChallengeModesTrace::RecordInteraction(Player* player, uint32 initiatorMask, uint32 targetMask, ChallengeInteraction interaction, ChallengeInteractionVerdict verdict)
+{
+    Push(player, TRACE_HOOK_INTERACTION, initiatorMask, targetMask, interaction, verdict, CHALLENGE_TRAIT_NONE);
+}
+
+ChallengeTraceStats ChallengeModesTrace::GetStats()
+{
+    ChallengeTraceStats stats;
+    stats.written = _written;
+
+    std::lock_guard<std::mutex> guard(_bufferLock);
+    stats.buffers = _buffers.size();
+    for (std::unique_ptr<Buffer> const& buffer : _buffers)
+    {
+        stats.dropped += buffer->dropped.load(std::memory_order_relaxed);
+    }
+    return stats;
+}
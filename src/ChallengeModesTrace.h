@@ -0,0 +1,87 @@
+#ifndef AZEROTHCORE_CHALLENGEMODESTRACE_H
+#define AZEROTHCORE_CHALLENGEMODESTRACE_H
+
+#include "ChallengeModes.h"
+#include "ChallengeModesTraceFormat.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+
+struct ChallengeTraceStats
+{
+    uint64 written = 0;
+    uint64 dropped = 0; // Records lost because a buffer was full between two flushes
+    uint32 buffers = 0;
+};
+
+/*
+ * Opt-in recorder of the module hooks, replayed offline with tools/trace_replay. Every thread that runs a hook
+ * appends to its own ring buffer without locking, the world thread drains the buffers to the trace file once per
+ * second. When a buffer is full the record is dropped and counted rather than blocking the hook.
+ */
+class ChallengeModesTrace
+{
+public:
+    static ChallengeModesTrace* instance();
+
+    // Set by the config, traceEnabled is only true while the trace file is open. It is stored with release order
+    // after the file and the start time, so a hook that loads it with acquire order sees both.
+    std::atomic<bool> traceEnabled{false};
+    uint32 bufferSize = 65536;
+
+    // Closes the current trace, then opens a new one when enabled
+    void Restart(bool enable, std::string const& path);
+    void Stop();
+    void Update(uint32 diff);
+
+    // OnGiveXP is traced around the challenge scripts: BeginXp runs before them with the base amount, RecordXp
+    // after them with the granted amount
+    void BeginXp(uint32 baseAmount) { PendingXp() = baseAmount; }
+    void RecordXp(Player* player, uint32 grantedAmount, bool kill);
+    void RecordEquip(Player* player, Item* item);
+    void RecordUse(Player* player, ItemTemplate const* proto);
+    void RecordSpell(Player* player, uint32 spellId);
+    void RecordInteraction(Player* player, uint32 initiatorMask, uint32 targetMask, ChallengeInteraction interaction, ChallengeInteractionVerdict verdict);
+
+    [[nodiscard]] ChallengeTraceStats GetStats();
+    [[nodiscard]] std::string const& GetPath() const { return _path; }
+
+private:
+    // Single producer (the owning thread), single consumer (the flushing thread)
+    struct Buffer
+    {
+        explicit Buffer(uint32 capacity) : records(new ChallengeTraceRecord[capacity]), capacity(capacity) { }
+
+        std::unique_ptr<ChallengeTraceRecord[]> records;
+        uint32 capacity; // Power of two
+        std::atomic<uint64> head{0};
+        std::atomic<uint64> tail{0};
+        std::atomic<uint64> dropped{0};
+        std::atomic<bool> pushing{false}; // Set by the owning thread while it is inside Push
+    };
+
+    static uint32& PendingXp()
+    {
+        thread_local uint32 amount = 0;
+        return amount;
+    }
+
+    void Push(Player* player, ChallengeTraceHook hook, uint32 challengeMask, uint32 subject, uint32 amount, uint32 result, uint8 traits);
+    Buffer& GetBuffer();
+    void Flush();
+    // Waits for the hooks that saw traceEnabled before it was cleared to finish their record
+    void Quiesce();
+
+    std::mutex _bufferLock;
+    std::vector<std::unique_ptr<Buffer>> _buffers; // Never shrinks, buffers of finished threads are still drained
+    std::FILE* _file = nullptr;
+    std::string _path;
+    std::chrono::steady_clock::time_point _startTime;
+    uint64 _written = 0;
+    uint32 _timer = IN_MILLISECONDS;
+};
+
+#define sChallengeModesTrace ChallengeModesTrace::instance()
+
+#endif //AZEROTHCORE_CHALLENGEMODESTRACE_H
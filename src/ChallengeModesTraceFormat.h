@@ -0,0 +1,58 @@
+#ifndef AZEROTHCORE_CHALLENGEMODESTRACEFORMAT_H
+#define AZEROTHCORE_CHALLENGEMODESTRACEFORMAT_H
+
+#include "ChallengeModesRules.h"
+
+/*
+ * Hook trace file: a ChallengeTraceFileHeader followed by ChallengeTraceRecords, little endian as written by the
+ * worldserver. Records are grouped by recording thread, sort them by time to get the order of the events.
+ */
+constexpr uint32 CHALLENGE_TRACE_MAGIC   = 0x52544D43; // "CMTR"
+constexpr uint16 CHALLENGE_TRACE_VERSION = 1;
+
+static_assert(SETTING_MODE_MAX <= 16, "Trace records store challenge masks in 16 bits");
+
+enum ChallengeTraceHook : uint8
+{
+    TRACE_HOOK_GIVE_XP     = 0,
+    TRACE_HOOK_EQUIP_ITEM  = 1,
+    TRACE_HOOK_USE_ITEM    = 2,
+    TRACE_HOOK_LEARN_SPELL = 3,
+    TRACE_HOOK_INTERACTION = 4,
+    TRACE_HOOK_MAX
+};
+
+#pragma pack(push, 1)
+
+struct ChallengeTraceFileHeader
+{
+    uint32 magic;
+    uint16 version;
+    uint16 recordSize;
+    uint8 challengeCount;   // SETTING_MODE_MAX of the worldserver
+    uint8 padding[3];
+    uint32 enabledMask;     // Challenges enabled in the config
+    uint64 startTime;       // Unix time when the trace was started
+    std::array<float, SETTING_MODE_MAX> xpMultipliers;
+    std::array<uint32, CHALLENGE_INTERACTION_MAX> exemptMasks; // See ChallengeModes::GetSameChallengeExemptMask
+};
+
+struct ChallengeTraceRecord
+{
+    uint64 time;            // Nanoseconds since the trace was started
+    uint32 playerGuid;
+    uint32 subject;         // Item entry, spell ID, or the challenge mask of the other player for interactions
+    uint32 amount;          // XP before the challenge adjustments, or the ChallengeInteraction
+    uint32 result;          // XP after the challenge adjustments, 1 if a check refused the action, or the ChallengeInteractionVerdict
+    uint16 challengeMask;   // Challenges enforced on the player
+    uint8 hook;             // ChallengeTraceHook
+    uint8 traits;           // ChallengeSubjectTraits
+    uint8 level;
+    uint8 padding[3];
+};
+
+#pragma pack(pop)
+
+static_assert(sizeof(ChallengeTraceRecord) == 32, "Trace records are written as is");
+
+#endif //AZEROTHCORE_CHALLENGEMODESTRACEFORMAT_H
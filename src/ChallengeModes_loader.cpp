@@ -4,6 +4,7 @@
 
 // From SC
 void AddSC_mod_challenge_modes();
+void AddSC_cs_challenge_modes();
 
 // Add all
 // cf. the naming convention https://github.com/azerothcore/azerothcore-wotlk/blob/master/doc/changelog/master.md#how-to-upgrade-4
@@ -11,4 +12,5 @@ void AddSC_mod_challenge_modes();
 void Addmod_challenge_modesScripts()
 {
     AddSC_mod_challenge_modes();
+    AddSC_cs_challenge_modes();
 }
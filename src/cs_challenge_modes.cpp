@@ -0,0 +1,330 @@
+/*
+ * Copyright (C) 2016+ AzerothCore <www.azerothcore.org>, released under GNU AGPL v3 license: https://github.com/azerothcore/azerothcore-wotlk/blob/master/LICENSE-AGPL3
+ */
+
+#include "ChallengeModes.h"
+#include "AccountMgr.h"
+#include "ChallengeModesAdmin.h"
+#include "ChallengeModesAuditor.h"
+#include "ChallengeModesRegistry.h"
+#include "ChallengeModesShadow.h"
+#include "ChallengeModesTrace.h"
+#include "CharacterCache.h"
+#include "Chat.h"
+#include "GameTime.h"
+#include "GuildMgr.h"
+#include "ScriptMgr.h"
+
+using namespace Acore::ChatCommands;
+
+class challenge_modes_commandscript : public CommandScript
+{
+public:
+    challenge_modes_commandscript() : CommandScript("challenge_modes_commandscript") { }
+
+    ChatCommandTable GetCommands() const override
+    {
+        static ChatCommandTable challengeCommandTable =
+        {
+            { "audit",     HandleChallengeAuditCommand,     SEC_GAMEMASTER, Console::Yes },
+            { "online",    HandleChallengeOnlineCommand,    SEC_GAMEMASTER, Console::Yes },
+            { "shadow",    HandleChallengeShadowCommand,    SEC_GAMEMASTER, Console::Yes },
+            { "trace",     HandleChallengeTraceCommand,     SEC_GAMEMASTER, Console::Yes },
+            { "list",      HandleChallengeListCommand,      SEC_GAMEMASTER, Console::Yes },
+            { "set",       HandleChallengeSetCommand,       SEC_GAMEMASTER, Console::Yes },
+            { "clear",     HandleChallengeClearCommand,     SEC_GAMEMASTER, Console::Yes },
+            { "revive",    HandleChallengeReviveCommand,    SEC_GAMEMASTER, Console::Yes },
+            { "markclean", HandleChallengeMarkCleanCommand, SEC_GAMEMASTER, Console::Yes },
+            { "bulk",      HandleChallengeBulkCommand,      SEC_ADMINISTRATOR, Console::Yes }
+        };
+
+        static ChatCommandTable commandTable =
+        {
+            { "challenge", challengeCommandTable }
+        };
+
+        return commandTable;
+    }
+
+    static bool HandleChallengeAuditCommand(ChatHandler* handler)
+    {
+        ChallengeAuditStats const& stats = sChallengeModesAuditor->GetStats();
+
+        handler->PSendSysMessage("Challenge audit: %s, budget %u us per update, interval %u s.",
+            sChallengeModesAuditor->auditEnabled ? "enabled" : "disabled", sChallengeModesAuditor->budget, sChallengeModesAuditor->interval / IN_MILLISECONDS);
+        if (sChallengeModesAuditor->IsCycleRunning())
+        {
+            handler->PSendSysMessage("Current pass: %u / %u players.", stats.cyclePosition, stats.cycleSize);
+        }
+        handler->PSendSysMessage("Completed passes: %u, last pass took %u ms.", stats.cycles, stats.lastCycleTime);
+        handler->PSendSysMessage("Players audited: " UI64FMTD ", items unequipped: " UI64FMTD ", enchantments removed: " UI64FMTD ", trade skills removed: " UI64FMTD ".",
+            stats.playersAudited, stats.itemsUnequipped, stats.enchantsRemoved, stats.spellsRemoved);
+        handler->PSendSysMessage("Updates used: " UI64FMTD ", average " UI64FMTD " us, max %u us.",
+            stats.ticks, stats.ticks ? stats.totalTime / stats.ticks : uint64(0), stats.maxTickTime);
+        return true;
+    }
+
+    // .challenge online [challenge] [fallen]
+    static bool HandleChallengeOnlineCommand(ChatHandler* handler, Optional<std::string> challengeName, Optional<std::string> fallen)
+    {
+        uint32 challengeMask = 0;
+        if (challengeName && *challengeName != "all")
+        {
+            ChallengeModeSettings setting;
+            if (!ChallengeModes::ParseChallengeName(*challengeName, setting))
+            {
+                handler->PSendSysMessage("Unknown challenge %s.", challengeName->c_str());
+                handler->SetSentErrorMessage(true);
+                return false;
+            }
+            challengeMask = ChallengeMask(setting);
+        }
+        bool includeFallen = fallen && *fallen == "fallen";
+
+        static constexpr uint32 MaxListed = 50;
+        std::vector<ChallengeRegistryEntry> entries = sChallengeModesRegistry->Find(challengeMask, includeFallen, MaxListed);
+        uint32 total = sChallengeModesRegistry->Count(challengeMask, includeFallen);
+
+        handler->PSendSysMessage("%u online character(s) match.", total);
+        for (ChallengeRegistryEntry const& entry : entries)
+        {
+            std::string name;
+            sCharacterCache->GetCharacterNameByGuid(ObjectGuid::Create<HighGuid::Player>(entry.guid), name);
+
+            std::string challenges;
+            for (uint8 i = 0; i < SETTING_MODE_MAX; ++i)
+            {
+                if (entry.activeMask & ChallengeMask(ChallengeModeSettings(i)))
+                {
+                    challenges += challenges.empty() ? "" : ", ";
+                    challenges += sChallengeModes->GetChallengeNameFromEnum(i);
+                }
+            }
+
+            handler->PSendSysMessage("%s - level %u%s - %s", name.c_str(), entry.level, entry.fallen ? " (fallen)" : "", challenges.c_str());
+        }
+
+        if (total > entries.size())
+        {
+            handler->PSendSysMessage("Only the first %u are listed.", MaxListed);
+        }
+        return true;
+    }
+
+    // .challenge shadow [reset]
+    static bool HandleChallengeShadowCommand(ChatHandler* handler, Optional<std::string> reset)
+    {
+        if (reset && *reset == "reset")
+        {
+            sChallengeModesShadow->Reset();
+            handler->SendSysMessage("Challenge shadow counters reset.");
+            return true;
+        }
+
+        if (!sChallengeModesShadow->shadowMask)
+        {
+            handler->SendSysMessage("No challenge is in shadow mode.");
+            return true;
+        }
+
+        for (uint8 i = 0; i < SETTING_MODE_MAX; ++i)
+        {
+            auto setting = ChallengeModeSettings(i);
+            if (!sChallengeModesShadow->IsShadowed(setting))
+            {
+                continue;
+            }
+
+            handler->PSendSysMessage("%s: %u player(s) would have been affected.", sChallengeModes->GetChallengeNameFromEnum(i).c_str(), sChallengeModesShadow->GetAffectedPlayerCount(setting));
+            for (uint8 hook = 0; hook < SHADOW_HOOK_MAX; ++hook)
+            {
+                ChallengeShadowCounters counters = sChallengeModesShadow->GetCounters(setting, ChallengeShadowHook(hook));
+                if (!counters.evaluations)
+                {
+                    continue;
+                }
+
+                handler->PSendSysMessage("  %s: " UI64FMTD " evaluated, " UI64FMTD " rejected, average " UI64FMTD " ns.", ChallengeModesShadow::GetHookName(ChallengeShadowHook(hook)),
+                    counters.evaluations, counters.rejections, counters.time / counters.evaluations);
+            }
+        }
+        return true;
+    }
+
+    static bool HandleChallengeTraceCommand(ChatHandler* handler)
+    {
+        if (!sChallengeModesTrace->traceEnabled)
+        {
+            handler->SendSysMessage("Hook tracing is disabled, see ChallengeModes.Trace.Enable.");
+            return true;
+        }
+
+        ChallengeTraceStats stats = sChallengeModesTrace->GetStats();
+        handler->PSendSysMessage("Tracing hooks to %s: " UI64FMTD " records written, " UI64FMTD " dropped, %u thread buffer(s).",
+            sChallengeModesTrace->GetPath().c_str(), stats.written, stats.dropped, stats.buffers);
+        return true;
+    }
+
+    // Parses a challenge name, or "all" when allowed
+    static bool ParseChallengeMask(ChatHandler* handler, std::string const& name, bool allowAll, uint32& challengeMask)
+    {
+        if (allowAll && name == "all")
+        {
+            challengeMask = CHALLENGE_MASK_COUNT - 1;
+            return true;
+        }
+
+        ChallengeModeSettings setting;
+        if (!ChallengeModes::ParseChallengeName(name, setting))
+        {
+            handler->PSendSysMessage("Unknown challenge %s.", name.c_str());
+            handler->SetSentErrorMessage(true);
+            return false;
+        }
+        challengeMask = ChallengeMask(setting);
+        return true;
+    }
+
+    static ObjectGuid GetRequester(ChatHandler* handler)
+    {
+        return handler->GetSession() && handler->GetSession()->GetPlayer() ? handler->GetSession()->GetPlayer()->GetGUID() : ObjectGuid::Empty;
+    }
+
+    // Runs the action on one character, the result is reported once the character has been loaded
+    static bool RunOnCharacter(ChatHandler* handler, Optional<PlayerIdentifier> player, ChallengeAdminAction action, uint32 challengeMask)
+    {
+        if (!player)
+        {
+            player = PlayerIdentifier::FromTargetOrSelf(handler);
+        }
+        if (!player)
+        {
+            handler->SendSysMessage("No character selected.");
+            handler->SetSentErrorMessage(true);
+            return false;
+        }
+
+        ChallengeAdminRequest request;
+        request.action = action;
+        request.target = ADMIN_TARGET_CHARACTER;
+        request.targetId = player->GetGUID().GetCounter();
+        request.challengeMask = challengeMask;
+        request.requester = GetRequester(handler);
+        sChallengeModesAdmin->Run(request);
+        return true;
+    }
+
+    // .challenge list [player]
+    static bool HandleChallengeListCommand(ChatHandler* handler, Optional<PlayerIdentifier> player)
+    {
+        return RunOnCharacter(handler, player, ADMIN_ACTION_LIST, 0);
+    }
+
+    // .challenge set <player> <challenge>
+    static bool HandleChallengeSetCommand(ChatHandler* handler, PlayerIdentifier player, std::string challengeName)
+    {
+        uint32 challengeMask = 0;
+        return ParseChallengeMask(handler, challengeName, false, challengeMask) && RunOnCharacter(handler, player, ADMIN_ACTION_SET, challengeMask);
+    }
+
+    // .challenge clear <player> <challenge|all>
+    static bool HandleChallengeClearCommand(ChatHandler* handler, PlayerIdentifier player, std::string challengeName)
+    {
+        uint32 challengeMask = 0;
+        return ParseChallengeMask(handler, challengeName, true, challengeMask) && RunOnCharacter(handler, player, ADMIN_ACTION_CLEAR, challengeMask);
+    }
+
+    // .challenge revive [player]
+    static bool HandleChallengeReviveCommand(ChatHandler* handler, Optional<PlayerIdentifier> player)
+    {
+        return RunOnCharacter(handler, player, ADMIN_ACTION_REVIVE, 0);
+    }
+
+    // .challenge markclean [player]
+    static bool HandleChallengeMarkCleanCommand(ChatHandler* handler, Optional<PlayerIdentifier> player)
+    {
+        return RunOnCharacter(handler, player, ADMIN_ACTION_MARK_CLEAN, 0);
+    }
+
+    // .challenge bulk <list|set|clear|revive|markclean> <account <name>|guild <name>|fallen <minutes>> [challenge|all]
+    // e.g. ".challenge bulk revive fallen 60 hardcore" revives every Hardcore character that died in the last hour
+    static bool HandleChallengeBulkCommand(ChatHandler* handler, std::string actionName, std::string targetType, std::string targetName, Optional<std::string> challengeName)
+    {
+        ChallengeAdminRequest request;
+        request.requester = GetRequester(handler);
+
+        uint8 action = 0;
+        while (action < ADMIN_ACTION_MAX && actionName != ChallengeModesAdmin::GetActionName(ChallengeAdminAction(action)))
+        {
+            ++action;
+        }
+        if (action == ADMIN_ACTION_MAX)
+        {
+            handler->PSendSysMessage("Unknown action %s, expected list, set, clear, revive or markclean.", actionName.c_str());
+            handler->SetSentErrorMessage(true);
+            return false;
+        }
+        request.action = ChallengeAdminAction(action);
+
+        if (challengeName && !ParseChallengeMask(handler, *challengeName, request.action != ADMIN_ACTION_SET, request.challengeMask))
+        {
+            return false;
+        }
+        if ((request.action == ADMIN_ACTION_SET || request.action == ADMIN_ACTION_CLEAR) && !request.challengeMask)
+        {
+            handler->PSendSysMessage("The %s action needs a challenge.", actionName.c_str());
+            handler->SetSentErrorMessage(true);
+            return false;
+        }
+
+        if (targetType == "account")
+        {
+            request.target = ADMIN_TARGET_ACCOUNT;
+            request.targetId = AccountMgr::GetId(targetName);
+            if (!request.targetId)
+            {
+                handler->PSendSysMessage("Account %s does not exist.", targetName.c_str());
+                handler->SetSentErrorMessage(true);
+                return false;
+            }
+        }
+        else if (targetType == "guild")
+        {
+            Guild* guild = sGuildMgr->GetGuildByName(targetName);
+            if (!guild)
+            {
+                handler->PSendSysMessage("Guild %s does not exist.", targetName.c_str());
+                handler->SetSentErrorMessage(true);
+                return false;
+            }
+            request.target = ADMIN_TARGET_GUILD;
+            request.targetId = guild->GetId();
+        }
+        else if (targetType == "fallen")
+        {
+            uint32 minutes = Acore::StringTo<uint32>(targetName).value_or(0);
+            if (!minutes)
+            {
+                handler->PSendSysMessage("Expected a number of minutes, got %s.", targetName.c_str());
+                handler->SetSentErrorMessage(true);
+                return false;
+            }
+            request.target = ADMIN_TARGET_FALLEN;
+            request.targetId = GameTime::GetGameTime().count() - std::min<uint64>(uint64(minutes) * MINUTE, GameTime::GetGameTime().count());
+        }
+        else
+        {
+            handler->PSendSysMessage("Unknown target %s, expected account, guild or fallen.", targetType.c_str());
+            handler->SetSentErrorMessage(true);
+            return false;
+        }
+
+        sChallengeModesAdmin->Run(request);
+        return true;
+    }
+};
+
+void AddSC_cs_challenge_modes()
+{
+    new challenge_modes_commandscript();
+}
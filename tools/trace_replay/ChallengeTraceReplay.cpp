@@ -0,0 +1,284 @@
+/*
+ * Copyright (C) 2016+ AzerothCore <www.azerothcore.org>, released under GNU AGPL v3 license: https://github.com/azerothcore/azerothcore-wotlk/blob/master/LICENSE-AGPL3
+ */
+
+/*
+ * Replays a hook trace recorded with ChallengeModes.Trace.Enable through the rules of ChallengeModesRules.h and
+ * reports the evaluation throughput and every verdict that differs from the recorded one. Rule changes are
+ * validated by rebuilding this tool against the changed module sources, config changes with the options below.
+ *
+ * Build, from this directory:
+ *     g++ -std=c++17 -O2 -I<azerothcore>/src/common -I../../src ChallengeTraceReplay.cpp -o challenge_trace_replay
+ *
+ * Usage:
+ *     challenge_trace_replay <trace file> [--iterations <n>] [--diffs <n>] [--disable <Challenge>]
+ *         [--multiplier <Challenge>=<value>] [--exempt <Challenge>=<interaction>]
+ *
+ * Challenges are named like their config prefix (Hardcore, SelfCrafted, ...), interactions like in
+ * <Challenge>.SameChallengeInteractions.
+ */
+
+#include "ChallengeModesTraceFormat.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+    char const* const HookNames[TRACE_HOOK_MAX] = { "give xp", "equip item", "use item", "learn spell", "interaction" };
+
+    struct ReplayConfig
+    {
+        uint32 enabledMask = 0;
+        std::array<float, SETTING_MODE_MAX> xpMultipliers = {};
+        std::array<uint32, CHALLENGE_INTERACTION_MAX> exemptMasks = {};
+        uint32 iterations = 10;
+        uint32 maxDiffsShown = 20;
+    };
+
+    // Mocked player store, filled from the trace as the players appear
+    struct ReplayPlayer
+    {
+        uint32 challengeMask = 0;
+        uint8 level = 0;
+    };
+
+    struct HookStats
+    {
+        uint64 events = 0;
+        uint64 diffs = 0;
+    };
+
+    bool ParseChallenge(std::string const& name, ChallengeModeSettings& setting)
+    {
+        for (uint8 i = 0; i < SETTING_MODE_MAX; ++i)
+        {
+            if (name == ChallengeModeDescriptors[i].configPrefix)
+            {
+                setting = ChallengeModeSettings(i);
+                return true;
+            }
+        }
+        std::fprintf(stderr, "Unknown challenge %s\n", name.c_str());
+        return false;
+    }
+
+    bool ParseInteraction(std::string const& name, ChallengeInteraction& interaction)
+    {
+        for (uint8 i = 0; i < CHALLENGE_INTERACTION_MAX; ++i)
+        {
+            if (name == ChallengeInteractionDescriptors[i].name)
+            {
+                interaction = ChallengeInteraction(i);
+                return true;
+            }
+        }
+        std::fprintf(stderr, "Unknown interaction %s\n", name.c_str());
+        return false;
+    }
+
+    // Splits "<Challenge>=<value>"
+    bool SplitAssignment(char const* arg, std::string& name, std::string& value)
+    {
+        char const* separator = std::strchr(arg, '=');
+        if (!separator)
+        {
+            std::fprintf(stderr, "Expected <Challenge>=<value>, got %s\n", arg);
+            return false;
+        }
+        name.assign(arg, separator);
+        value.assign(separator + 1);
+        return true;
+    }
+
+    bool LoadTrace(char const* path, ChallengeTraceFileHeader& header, std::vector<ChallengeTraceRecord>& records)
+    {
+        std::FILE* file = std::fopen(path, "rb");
+        if (!file)
+        {
+            std::fprintf(stderr, "Cannot open %s\n", path);
+            return false;
+        }
+
+        bool valid = std::fread(&header, sizeof(header), 1, file) == 1 &&
+            header.magic == CHALLENGE_TRACE_MAGIC && header.version == CHALLENGE_TRACE_VERSION &&
+            header.recordSize == sizeof(ChallengeTraceRecord) && header.challengeCount == SETTING_MODE_MAX;
+        if (!valid)
+        {
+            std::fprintf(stderr, "%s is not a version %u trace of a worldserver with %u challenges\n", path, uint32(CHALLENGE_TRACE_VERSION), uint32(SETTING_MODE_MAX));
+            std::fclose(file);
+            return false;
+        }
+
+        ChallengeTraceRecord record;
+        while (std::fread(&record, sizeof(record), 1, file) == 1)
+        {
+            records.push_back(record);
+        }
+        std::fclose(file);
+
+        // Records are written per recording thread
+        std::stable_sort(records.begin(), records.end(), [](ChallengeTraceRecord const& a, ChallengeTraceRecord const& b) { return a.time < b.time; });
+        return true;
+    }
+
+    // Replays one record against the current rules and config, returns the verdict the module would give now
+    uint32 Evaluate(ReplayConfig const& config, ReplayPlayer const& player, ChallengeTraceRecord const& record)
+    {
+        uint32 challengeMask = player.challengeMask & config.enabledMask;
+        switch (record.hook)
+        {
+            case TRACE_HOOK_GIVE_XP:
+                return ChallengeAdjustXp(challengeMask, config.xpMultipliers, record.amount, record.traits);
+            case TRACE_HOOK_EQUIP_ITEM:
+                return ChallengeRefusesEquip(ChallengeRuleFlags(challengeMask), record.traits);
+            case TRACE_HOOK_USE_ITEM:
+                return ChallengeRefusesUse(ChallengeRuleFlags(challengeMask), record.traits);
+            case TRACE_HOOK_LEARN_SPELL:
+                return ChallengeRefusesSpell(ChallengeRuleFlags(challengeMask), record.traits);
+            case TRACE_HOOK_INTERACTION:
+            {
+                auto interaction = ChallengeInteraction(record.amount);
+                uint32 restrictedMask = ChallengeRuleMask(ChallengeInteractionDescriptors[interaction].ruleFlag) & config.enabledMask;
+                return ChallengeEvaluateInteraction(interaction, restrictedMask, config.exemptMasks[interaction], challengeMask, record.subject & config.enabledMask);
+            }
+            default:
+                return record.result;
+        }
+    }
+
+    // Updates the mocked player store from the record, as the module would have loaded it
+    ReplayPlayer& LookupPlayer(std::unordered_map<uint32, ReplayPlayer>& players, ChallengeTraceRecord const& record)
+    {
+        ReplayPlayer& player = players[record.playerGuid];
+        player.challengeMask = record.challengeMask;
+        player.level = record.level;
+        return player;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        std::fprintf(stderr, "Usage: %s <trace file> [--iterations <n>] [--diffs <n>] [--disable <Challenge>] [--multiplier <Challenge>=<value>] [--exempt <Challenge>=<interaction>]\n", argv[0]);
+        return 1;
+    }
+
+    ChallengeTraceFileHeader header;
+    std::vector<ChallengeTraceRecord> records;
+    if (!LoadTrace(argv[1], header, records))
+    {
+        return 1;
+    }
+
+    ReplayConfig config;
+    config.enabledMask = header.enabledMask;
+    config.xpMultipliers = header.xpMultipliers;
+    config.exemptMasks = header.exemptMasks;
+
+    for (int i = 2; i + 1 < argc; i += 2)
+    {
+        std::string option = argv[i];
+        std::string name;
+        std::string value;
+        ChallengeModeSettings setting;
+        if (option == "--iterations")
+        {
+            config.iterations = std::max(std::atoi(argv[i + 1]), 1);
+        }
+        else if (option == "--diffs")
+        {
+            config.maxDiffsShown = std::atoi(argv[i + 1]);
+        }
+        else if (option == "--disable" && ParseChallenge(argv[i + 1], setting))
+        {
+            config.enabledMask &= ~ChallengeMask(setting);
+        }
+        else if (option == "--multiplier" && SplitAssignment(argv[i + 1], name, value) && ParseChallenge(name, setting))
+        {
+            config.xpMultipliers[setting] = std::atof(value.c_str());
+        }
+        else if (option == "--exempt" && SplitAssignment(argv[i + 1], name, value) && ParseChallenge(name, setting))
+        {
+            ChallengeInteraction interaction;
+            if (!ParseInteraction(value, interaction))
+            {
+                return 1;
+            }
+            config.exemptMasks[interaction] |= ChallengeMask(setting);
+        }
+        else
+        {
+            std::fprintf(stderr, "Invalid option %s %s\n", option.c_str(), argv[i + 1]);
+            return 1;
+        }
+    }
+
+    uint64 duration = records.empty() ? 0 : records.back().time - records.front().time;
+    std::printf("%zu records over %.1f s of traffic\n", records.size(), duration / 1e9);
+
+    // Verdict pass: compares the replayed verdicts with the recorded ones
+    std::array<HookStats, TRACE_HOOK_MAX> hookStats = {};
+    std::unordered_map<uint32, ReplayPlayer> players;
+    uint32 diffsShown = 0;
+    for (ChallengeTraceRecord const& record : records)
+    {
+        if (record.hook >= TRACE_HOOK_MAX)
+        {
+            continue;
+        }
+
+        ReplayPlayer const& player = LookupPlayer(players, record);
+        uint32 verdict = Evaluate(config, player, record);
+        HookStats& stats = hookStats[record.hook];
+        ++stats.events;
+        if (verdict == record.result)
+        {
+            continue;
+        }
+
+        ++stats.diffs;
+        if (diffsShown < config.maxDiffsShown)
+        {
+            ++diffsShown;
+            std::printf("  diff at %.3f s: %s, player %u level %u, mask 0x%x, subject %u, amount %u: recorded %u, replayed %u\n",
+                record.time / 1e9, HookNames[record.hook], record.playerGuid, uint32(record.level), uint32(record.challengeMask),
+                record.subject, record.amount, record.result, verdict);
+        }
+    }
+
+    std::printf("%zu players\n", players.size());
+    for (uint8 hook = 0; hook < TRACE_HOOK_MAX; ++hook)
+    {
+        std::printf("  %-12s %10llu events %10llu diffs\n", HookNames[hook], (unsigned long long)hookStats[hook].events, (unsigned long long)hookStats[hook].diffs);
+    }
+
+    // Throughput pass: the evaluation alone, repeated to get a stable measurement
+    using Clock = std::chrono::steady_clock;
+    uint64 checksum = 0;
+    auto const start = Clock::now();
+    for (uint32 iteration = 0; iteration < config.iterations; ++iteration)
+    {
+        players.clear();
+        for (ChallengeTraceRecord const& record : records)
+        {
+            checksum += Evaluate(config, LookupPlayer(players, record), record);
+        }
+    }
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    double evaluated = double(records.size()) * config.iterations;
+
+    std::printf("Throughput: %.0f events/s, %.1f ns/event over %u iterations (checksum %llu)\n",
+        elapsed > 0 ? evaluated / elapsed : 0.0, evaluated > 0 ? elapsed * 1e9 / evaluated : 0.0, config.iterations, (unsigned long long)checksum);
+    if (duration)
+    {
+        std::printf("Recorded rate: %.0f events/s\n", records.size() / (duration / 1e9));
+    }
+    return 0;
+}
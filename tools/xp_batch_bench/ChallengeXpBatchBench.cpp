@@ -0,0 +1,241 @@
+/*
+ * Copyright (C) 2016+ AzerothCore <www.azerothcore.org>, released under GNU AGPL v3 license: https://github.com/azerothcore/azerothcore-wotlk/blob/master/LICENSE-AGPL3
+ */
+
+/*
+ * Compares the XP evaluation of raid kills with one script per challenge, as the module did before
+ * ChallengeModes::AdjustXp, with the OnGiveXP hook calling AdjustXp once per member and with one batch AdjustXp
+ * call per kill. The hook and batch paths use ChallengeAdjustXp and ChallengeAdjustXpBatch from
+ * ChallengeModesRules.h. Players are mocked with their CustomData map, so every challenge mask lookup costs what
+ * it costs in the worldserver. The three paths must grant the same amounts, the tool fails otherwise.
+ *
+ * Build, from this directory:
+ *     g++ -std=c++17 -O2 -I<azerothcore>/src/common -I../../src ChallengeXpBatchBench.cpp -o challenge_xp_batch_bench
+ *
+ * Usage:
+ *     challenge_xp_batch_bench [--kills <n>] [--members <n>] [--quest]
+ */
+
+#include "ChallengeModesRules.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+    // Player::CustomData holds ChallengeModePlayerData under a string key
+    struct MockData
+    {
+        virtual ~MockData() = default;
+    };
+
+    struct MockPlayerData : MockData
+    {
+        uint32 activeMask = 0;
+        bool fallen = false;
+    };
+
+    struct MockPlayer
+    {
+        std::unordered_map<std::string, std::unique_ptr<MockData>> customData;
+        uint8 level = 0;
+    };
+
+    struct BenchConfig
+    {
+        uint32 enabledMask = 0;
+        std::array<float, SETTING_MODE_MAX> xpMultipliers = {};
+        uint32 kills = 100000;
+        uint32 members = 40;
+        bool kill = true;
+    };
+
+    uint32 GetEnforcedChallengeMask(BenchConfig const& config, MockPlayer& player)
+    {
+        auto itr = player.customData.find("ChallengeModes");
+        if (itr == player.customData.end())
+        {
+            return 0;
+        }
+        auto data = static_cast<MockPlayerData const*>(itr->second.get());
+        return data->fallen ? 0 : (data->activeMask & config.enabledMask);
+    }
+
+    // One script per challenge, each looking up the mask, like ChallengeMode::OnGiveXP did
+    class ChallengeScript
+    {
+    public:
+        explicit ChallengeScript(ChallengeModeSettings setting) : _setting(setting) { }
+        virtual ~ChallengeScript() = default;
+
+        virtual void OnGiveXP(BenchConfig const& config, MockPlayer& player, uint32& amount, bool kill)
+        {
+            if (!(config.enabledMask & ChallengeMask(_setting)) || !(GetEnforcedChallengeMask(config, player) & ChallengeMask(_setting)))
+            {
+                return;
+            }
+            if (kill && (ChallengeModeDescriptors[_setting].ruleFlags & CHALLENGE_RULE_QUEST_XP_ONLY))
+            {
+                amount = 0;
+                return;
+            }
+            amount *= config.xpMultipliers[_setting];
+        }
+
+    private:
+        ChallengeModeSettings _setting;
+    };
+
+    struct Raid
+    {
+        std::vector<MockPlayer*> players;
+        std::vector<uint32> amounts;
+    };
+
+    std::vector<std::unique_ptr<MockPlayer>> CreatePlayers(uint32 count, std::mt19937& random)
+    {
+        std::vector<std::unique_ptr<MockPlayer>> players;
+        for (uint32 i = 0; i < count; ++i)
+        {
+            auto player = std::make_unique<MockPlayer>();
+            auto data = std::make_unique<MockPlayerData>();
+            // About a third of the players have challenges, some of them several
+            if (random() % 3 == 0)
+            {
+                data->activeMask = random() & (CHALLENGE_MASK_COUNT - 1);
+            }
+            data->fallen = random() % 50 == 0;
+            player->customData["ChallengeModes"] = std::move(data);
+            player->level = 1 + random() % 80;
+            players.push_back(std::move(player));
+        }
+        return players;
+    }
+
+    template<typename Evaluate>
+    double Measure(BenchConfig const& config, std::vector<Raid> const& raids, std::vector<uint32>& granted, Evaluate&& evaluate)
+    {
+        using Clock = std::chrono::steady_clock;
+        granted.clear();
+        std::vector<uint32> amounts;
+        auto const start = Clock::now();
+        for (uint32 kill = 0; kill < config.kills; ++kill)
+        {
+            Raid const& raid = raids[kill % raids.size()];
+            amounts = raid.amounts;
+            evaluate(raid, amounts);
+            granted.insert(granted.end(), amounts.begin(), amounts.end());
+        }
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+}
+
+int main(int argc, char** argv)
+{
+    BenchConfig config;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string option = argv[i];
+        if (option == "--kills" && i + 1 < argc)
+        {
+            config.kills = std::max(std::atoi(argv[++i]), 1);
+        }
+        else if (option == "--members" && i + 1 < argc)
+        {
+            config.members = std::max(std::atoi(argv[++i]), 1);
+        }
+        else if (option == "--quest")
+        {
+            config.kill = false;
+        }
+        else
+        {
+            std::fprintf(stderr, "Usage: %s [--kills <n>] [--members <n>] [--quest]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    for (uint8 i = 0; i < SETTING_MODE_MAX; ++i)
+    {
+        if (ChallengeModeDescriptors[i].compiled)
+        {
+            config.enabledMask |= ChallengeMask(ChallengeModeSettings(i));
+        }
+        config.xpMultipliers[i] = ChallengeModeDescriptors[i].defaultXpMultiplier;
+    }
+
+    std::mt19937 random(42);
+    std::vector<std::unique_ptr<MockPlayer>> players = CreatePlayers(config.members * 16, random);
+    std::vector<Raid> raids(64);
+    for (Raid& raid : raids)
+    {
+        for (uint32 i = 0; i < config.members; ++i)
+        {
+            raid.players.push_back(players[random() % players.size()].get());
+            raid.amounts.push_back(100 + random() % 5000);
+        }
+    }
+
+    std::vector<std::unique_ptr<ChallengeScript>> scripts;
+    for (uint8 i = 0; i < SETTING_MODE_MAX; ++i)
+    {
+        scripts.push_back(std::make_unique<ChallengeScript>(ChallengeModeSettings(i)));
+    }
+
+    std::vector<uint32> perChallengeGranted;
+    double perChallenge = Measure(config, raids, perChallengeGranted, [&](Raid const& raid, std::vector<uint32>& amounts)
+    {
+        for (size_t i = 0; i < amounts.size(); ++i)
+        {
+            for (std::unique_ptr<ChallengeScript> const& script : scripts)
+            {
+                script->OnGiveXP(config, *raid.players[i], amounts[i], config.kill);
+            }
+        }
+    });
+
+    // ChallengeXpScripts::OnGiveXP, AdjustXp for one member: one mask lookup and ChallengeAdjustXp
+    uint8 const traits = config.kill ? CHALLENGE_TRAIT_KILL : 0;
+    std::vector<uint32> perHookGranted;
+    double perHook = Measure(config, raids, perHookGranted, [&](Raid const& raid, std::vector<uint32>& amounts)
+    {
+        for (size_t i = 0; i < amounts.size(); ++i)
+        {
+            if (uint32 challengeMask = GetEnforcedChallengeMask(config, *raid.players[i]))
+            {
+                amounts[i] = ChallengeAdjustXp(challengeMask, config.xpMultipliers, amounts[i], traits);
+            }
+        }
+    });
+
+    // ChallengeModes::AdjustXp for all recipients of the kill: the masks first, then the rules over the arrays
+    std::vector<uint32> masks(config.members);
+    std::vector<uint32> batchGranted;
+    double batch = Measure(config, raids, batchGranted, [&](Raid const& raid, std::vector<uint32>& amounts)
+    {
+        for (size_t i = 0; i < amounts.size(); ++i)
+        {
+            masks[i] = GetEnforcedChallengeMask(config, *raid.players[i]);
+        }
+        ChallengeAdjustXpBatch(masks.data(), amounts.data(), amounts.size(), config.xpMultipliers, traits);
+    });
+
+    double const recipients = double(config.kills) * config.members;
+    std::printf("%u %s rewards of %u members\n", config.kills, config.kill ? "kill" : "quest", config.members);
+    std::printf("  per challenge script %8.1f ns/kill %6.1f ns/member\n", perChallenge * 1e9 / config.kills, perChallenge * 1e9 / recipients);
+    std::printf("  per hook             %8.1f ns/kill %6.1f ns/member\n", perHook * 1e9 / config.kills, perHook * 1e9 / recipients);
+    std::printf("  batch                %8.1f ns/kill %6.1f ns/member\n", batch * 1e9 / config.kills, batch * 1e9 / recipients);
+
+    if (perHookGranted != perChallengeGranted || batchGranted != perChallengeGranted)
+    {
+        std::printf("The granted amounts differ between the paths\n");
+        return 1;
+    }
+    return 0;
+}